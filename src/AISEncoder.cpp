@@ -0,0 +1,134 @@
+/*
+AISEncoder.cpp
+
+Encoding of AIS messages into 6-bit armored payload. See header for details.
+*/
+
+#include "AISEncoder.h"
+#include <math.h>
+#include <string.h>
+
+// 6-bit value to payload character
+static const char AISArmorTable[65] =
+  "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVW`abcdefghijklmnopqrstuvw";
+
+// ASCII to 6-bit text value. Unprintable characters map to '@' (0), which is
+// also what NMEA2000 devices commonly use for padding.
+class tAISTextTable {
+public:
+  uint8_t Value[256];
+  tAISTextTable() {
+    for (int c = 0; c < 256; c++) {
+      int u = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+      if (u >= 64 && u < 96) Value[c] = u - 64;
+      else if (u >= 32 && u < 64) Value[c] = u;
+      else Value[c] = 0;
+    }
+  }
+};
+static const tAISTextTable AISTextTable;
+
+const uint16_t tAISBitPacker::MaxFragmentChars;
+
+//*****************************************************************************
+void tAISBitPacker::Clear() {
+  memset(Symbols, 0, sizeof(Symbols));
+  BitLen = 0;
+}
+
+//*****************************************************************************
+void tAISBitPacker::AddUInt(uint32_t Value, uint8_t Bits) {
+  if (Bits > 32 || BitLen + Bits > MaxBits) return;
+  // Fill the current symbol, then whole symbols, up to 6 bits at a time
+  while (Bits > 0) {
+    uint8_t Free = 6 - (BitLen % 6);
+    uint8_t Take = (Bits < Free) ? Bits : Free;
+    uint8_t Chunk = (Value >> (Bits - Take)) & ((1u << Take) - 1);
+    Symbols[BitLen / 6] |= Chunk << (Free - Take);
+    BitLen += Take;
+    Bits -= Take;
+  }
+}
+
+//*****************************************************************************
+void tAISBitPacker::AddText(const char *Text, size_t TextLen, uint8_t Chars) {
+  bool End = (Text == 0);
+  for (uint8_t i = 0; i < Chars; i++) {
+    if (!End && (i >= TextLen || Text[i] == 0)) End = true;
+    AddUInt(End ? 0 : AISTextTable.Value[(uint8_t)Text[i]], 6);
+  }
+}
+
+//*****************************************************************************
+uint8_t tAISBitPacker::GetFragmentCount() const {
+  uint16_t nSymbols = (BitLen + 5) / 6;
+  return (nSymbols + MaxFragmentChars - 1) / MaxFragmentChars;
+}
+
+//*****************************************************************************
+bool tAISBitPacker::GetFragment(uint8_t Fragment, char *Payload, uint8_t &FillBits) const {
+  uint16_t nSymbols = (BitLen + 5) / 6;
+  uint16_t Start = Fragment * MaxFragmentChars;
+  if (Start >= nSymbols) return false;
+  uint16_t End = Start + MaxFragmentChars;
+  if (End >= nSymbols) {
+    End = nSymbols;
+    FillBits = nSymbols * 6 - BitLen;
+  } else {
+    FillBits = 0;
+  }
+  for (uint16_t i = Start; i < End; i++) {
+    *Payload++ = AISArmorTable[Symbols[i]];
+  }
+  *Payload = 0;
+  return true;
+}
+
+//*****************************************************************************
+int32_t AISLongitude(int32_t N2kLongitude) {
+  if (N2kLongitude == 0x7fffffff) return 181 * 600000; // Not available
+  // 1e-7 deg -> 1/600000 deg
+  return (int32_t)lround(N2kLongitude * 0.06);
+}
+
+//*****************************************************************************
+int32_t AISLatitude(int32_t N2kLatitude) {
+  if (N2kLatitude == 0x7fffffff) return 91 * 600000; // Not available
+  return (int32_t)lround(N2kLatitude * 0.06);
+}
+
+//*****************************************************************************
+uint16_t AISSpeed(uint16_t N2kSOG) {
+  if (N2kSOG >= 0xfffe) return 1023; // Not available
+  long Speed = lround(N2kSOG * (0.01 * 3600.0 / 1852.0 * 10.0));
+  return (Speed > 1022) ? 1022 : Speed;
+}
+
+//*****************************************************************************
+uint16_t AISCourse(uint16_t N2kCOG) {
+  if (N2kCOG >= 0xfffe) return 3600; // Not available
+  return lround(N2kCOG * (1e-4 * 1800.0 / M_PI)) % 3600;
+}
+
+//*****************************************************************************
+uint16_t AISHeading(uint16_t N2kHeading) {
+  if (N2kHeading >= 0xfffe) return 511; // Not available
+  return lround(N2kHeading * (1e-4 * 180.0 / M_PI)) % 360;
+}
+
+//*****************************************************************************
+int8_t AISRateOfTurn(int16_t N2kROT) {
+  if (N2kROT == 0x7fff || N2kROT == 0x7ffe) return -128; // Not available
+  // ROTais = 4.733 * sqrt(ROT deg/min)
+  double DegPerMin = fabs(N2kROT * (3.125e-5 * 180.0 / M_PI * 60.0));
+  long ROT = lround(4.733 * sqrt(DegPerMin));
+  if (ROT > 126) ROT = 126;
+  return (N2kROT < 0) ? -ROT : ROT;
+}
+
+//*****************************************************************************
+uint16_t AISDimension(uint16_t N2kLength, uint16_t Max) {
+  if (N2kLength >= 0xfffe) return 0; // Not available
+  long Length = lround(N2kLength * 0.1);
+  return (Length > Max) ? Max : Length;
+}
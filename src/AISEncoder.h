@@ -0,0 +1,67 @@
+/*
+AISEncoder.h
+
+Encoding of AIS messages into the 6-bit armored payload used by !AIVDM
+and !AIVDO sentences. Bits are packed directly into 6-bit symbols and
+armored with a lookup table, so encoding does not allocate or loop per bit.
+
+Also includes conversion helpers from raw NMEA2000 field values to the
+AIS field encodings (ITU-R M.1371).
+*/
+
+#ifndef AIS_ENCODER_H
+#define AIS_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+class tAISBitPacker {
+public:
+  // Longest message we encode is message 5 (static and voyage data)
+  static const uint16_t MaxBits=424;
+  static const uint16_t MaxSymbols=(MaxBits+5)/6;
+  // Payload characters per sentence. Keeps sentences within 82 chars.
+  static const uint16_t MaxFragmentChars=60;
+
+protected:
+  uint8_t Symbols[MaxSymbols];
+  uint16_t BitLen;
+
+public:
+  tAISBitPacker() { Clear(); }
+  void Clear();
+  // Adds Bits lowest bits of Value, most significant first. Signed values
+  // can be added as is, they are truncated to two's complement of Bits.
+  void AddUInt(uint32_t Value, uint8_t Bits);
+  void AddInt(int32_t Value, uint8_t Bits) { AddUInt((uint32_t)Value, Bits); }
+  // Adds Chars characters of 6-bit text. Text shorter than Chars (or ending
+  // in NUL) is padded with '@'. Lower case is converted to upper case.
+  void AddText(const char *Text, size_t TextLen, uint8_t Chars);
+
+  uint16_t GetBitLength() const { return BitLen; }
+  uint8_t GetFragmentCount() const;
+  // Writes armored payload for fragment (0 based) to Payload, which must hold
+  // at least MaxFragmentChars+1 chars. FillBits is set for the last fragment,
+  // otherwise 0. Returns false, if fragment does not exist.
+  bool GetFragment(uint8_t Fragment, char *Payload, uint8_t &FillBits) const;
+};
+
+//------------------------------------------------------------------------------
+// Conversions from raw NMEA2000 values to AIS field values
+
+// Position in 1e-7 degrees to AIS 1/10000 minutes
+int32_t AISLongitude(int32_t N2kLongitude);
+int32_t AISLatitude(int32_t N2kLatitude);
+// SOG in 0.01 m/s to AIS 0.1 knots
+uint16_t AISSpeed(uint16_t N2kSOG);
+// COG in 1e-4 rad to AIS 0.1 degrees
+uint16_t AISCourse(uint16_t N2kCOG);
+// Heading in 1e-4 rad to AIS whole degrees
+uint16_t AISHeading(uint16_t N2kHeading);
+// Rate of turn in 3.125e-5 rad/s to AIS ROT indicator
+int8_t AISRateOfTurn(int16_t N2kROT);
+// Length in 0.1 m to AIS whole meters limited to field maximum
+uint16_t AISDimension(uint16_t N2kLength, uint16_t Max);
+
+#endif // AIS_ENCODER_H
@@ -0,0 +1,239 @@
+/*
+BusAnalyzer.cpp
+
+NMEA2000 bus load and per-device traffic analysis. See header for details.
+*/
+
+#include "BusAnalyzer.h"
+#include <stdio.h>
+#include <string.h>
+
+static const unsigned long AddressClaimPGN = 60928UL;
+
+// Fast packet PGNs of the standard, and the proprietary fast packet range
+struct tPGNRange {
+  unsigned long First;
+  unsigned long Last;
+};
+static const tPGNRange FastPacketPGNs[] = {
+  { 126208UL, 126208UL }, { 126464UL, 126464UL }, { 126996UL, 126996UL }, { 126998UL, 126998UL },
+  { 127233UL, 127233UL }, { 127237UL, 127237UL }, { 127489UL, 127489UL }, { 127496UL, 127498UL },
+  { 127503UL, 127504UL }, { 127506UL, 127506UL }, { 127510UL, 127510UL }, { 128275UL, 128275UL },
+  { 128520UL, 128520UL }, { 129029UL, 129029UL }, { 129038UL, 129041UL }, { 129044UL, 129045UL },
+  { 129284UL, 129285UL }, { 129301UL, 129302UL }, { 129538UL, 129538UL }, { 129540UL, 129542UL },
+  { 129545UL, 129545UL }, { 129547UL, 129547UL }, { 129549UL, 129549UL }, { 129551UL, 129551UL },
+  { 129556UL, 129556UL }, { 129792UL, 129810UL }, { 130060UL, 130061UL }, { 130064UL, 130074UL },
+  { 130320UL, 130324UL }, { 130567UL, 130567UL }, { 130569UL, 130573UL }, { 130577UL, 130578UL },
+  { 130816UL, 131071UL }
+};
+
+//*****************************************************************************
+tBusAnalyzer::tBusAnalyzer() : FramesTotal(0), BitsTotal(0), EntryCount(0), EntryOverflows(0),
+    ClaimsTotal(0), ClaimChanges(0), CannotClaim(0) {
+  memset(&Bus, 0, sizeof(Bus));
+  memset(Sources, 0, sizeof(Sources));
+  memset(Entries, 0, sizeof(Entries));
+}
+
+//*****************************************************************************
+bool tBusAnalyzer::IsFastPacketPGN(unsigned long PGN) {
+  for (size_t i = 0; i < sizeof(FastPacketPGNs) / sizeof(FastPacketPGNs[0]); i++) {
+    if (PGN < FastPacketPGNs[i].First) return false;
+    if (PGN <= FastPacketPGNs[i].Last) return true;
+  }
+  return false;
+}
+
+//*****************************************************************************
+static inline void PutBits(uint8_t *Bits, size_t &n, uint32_t Value, int Count) {
+  for (int i = Count - 1; i >= 0; i--) Bits[n++] = (Value >> i) & 1;
+}
+
+//*****************************************************************************
+uint32_t tBusAnalyzer::FrameBits(unsigned long id, unsigned char len, const unsigned char *buf) {
+  if (len > 8) len = 8;
+  // Start of frame to end of CRC: 1+11+1+1+18+1+2+4+64+15 bits at most
+  uint8_t Bits[118];
+  size_t n = 0;
+  PutBits(Bits, n, 0, 1); // SOF
+  PutBits(Bits, n, id >> 18, 11); // Base identifier
+  PutBits(Bits, n, 3, 2); // SRR, IDE
+  PutBits(Bits, n, id & 0x3ffff, 18); // Identifier extension
+  PutBits(Bits, n, 0, 3); // RTR, r1, r0
+  PutBits(Bits, n, len, 4);
+  for (unsigned char i = 0; i < len; i++) PutBits(Bits, n, buf[i], 8);
+  uint16_t CRC = 0;
+  for (size_t i = 0; i < n; i++) {
+    bool Next = Bits[i] ^ ((CRC >> 14) & 1);
+    CRC = (CRC << 1) & 0x7fff;
+    if (Next) CRC ^= 0x4599;
+  }
+  PutBits(Bits, n, CRC, 15);
+  // After five equal bits the transmitter inserts an opposite one, which
+  // starts the next run
+  uint32_t Stuff = 0;
+  uint8_t Last = Bits[0];
+  int Run = 1;
+  for (size_t i = 1; i < n; i++) {
+    if (Bits[i] == Last) {
+      Run++;
+    } else {
+      Last = Bits[i];
+      Run = 1;
+    }
+    if (Run == 5) {
+      Stuff++;
+      Last = !Last;
+      Run = 1;
+    }
+  }
+  // CRC delimiter, ACK slot and delimiter, end of frame, intermission
+  return n + Stuff + 1 + 2 + 7 + 3;
+}
+
+//*****************************************************************************
+// Open addressing with linear probing. Entries are never removed.
+tBusAnalyzer::tEntry* tBusAnalyzer::FindEntry(unsigned long PGN, uint8_t Source) {
+  size_t i = ((PGN * 31) ^ (Source * 2654435761UL)) % MaxEntries;
+  for (size_t Probes = 0; Probes < MaxEntries; Probes++, i = (i + 1) % MaxEntries) {
+    tEntry &Entry = Entries[i];
+    if (Entry.Used) {
+      if (Entry.PGN == PGN && Entry.Source == Source) return &Entry;
+      continue;
+    }
+    if (EntryCount >= MaxUsedEntries) break;
+    Entry.Used = true;
+    Entry.PGN = PGN;
+    Entry.Source = Source;
+    Entry.FastPacket = IsFastPacketPGN(PGN);
+    Entry.BrokenSequence = 0xff;
+    EntryCount++;
+    return &Entry;
+  }
+  EntryOverflows++;
+  return 0;
+}
+
+//*****************************************************************************
+// First frame of a sequence has frame counter 0 and message length, later
+// frames must follow in order with the same sequence number.
+void tBusAnalyzer::AddFastPacketFrame(tEntry &Entry, const unsigned char *buf, unsigned char len) {
+  if (len < 2) return;
+  uint8_t Sequence = buf[0] >> 5;
+  uint8_t Frame = buf[0] & 0x1f;
+  if (Frame == 0) {
+    if (Entry.InProgress) Entry.Incomplete++;
+    Entry.BrokenSequence = 0xff;
+    Entry.FramesExpected = (buf[1] <= 6) ? 1 : 1 + (buf[1] - 6 + 6) / 7;
+    if (Entry.FramesExpected == 1) {
+      Entry.InProgress = false;
+      Entry.Complete++;
+    } else {
+      Entry.InProgress = true;
+      Entry.Sequence = Sequence;
+      Entry.NextFrame = 1;
+    }
+    return;
+  }
+  if (Entry.InProgress && Sequence == Entry.Sequence && Frame == Entry.NextFrame) {
+    if (++Entry.NextFrame == Entry.FramesExpected) {
+      Entry.InProgress = false;
+      Entry.Complete++;
+    }
+    return;
+  }
+  // Lost or reordered frame breaks the sequence. Rest of its frames are
+  // ignored, also when its first frame was lost.
+  if (Entry.InProgress || Sequence != Entry.BrokenSequence) {
+    Entry.Incomplete++;
+  }
+  Entry.InProgress = false;
+  Entry.BrokenSequence = Sequence;
+}
+
+//*****************************************************************************
+void tBusAnalyzer::AddAddressClaim(uint8_t Source, const unsigned char *buf, unsigned char len) {
+  if (len < 8) return;
+  ClaimsTotal++;
+  // Null address is used by devices, which could not claim any address
+  if (Source == 254) {
+    CannotClaim++;
+    return;
+  }
+  uint64_t Name = 0;
+  for (int i = 0; i < 8; i++) Name |= (uint64_t)buf[i] << (8 * i);
+  tSource &Src = Sources[Source];
+  if (Src.Claims > 0 && Src.Name != Name) ClaimChanges++;
+  Src.Name = Name;
+  Src.Claims++;
+}
+
+//*****************************************************************************
+void tBusAnalyzer::AddFrame(unsigned long id, unsigned char len, const unsigned char *buf) {
+  if (len > 8) len = 8;
+  uint32_t Bits = FrameBits(id, len, buf);
+  uint8_t Source = id & 0xff;
+  uint8_t PF = (id >> 16) & 0xff;
+  unsigned long PGN = (id >> 8) & 0x3ffff;
+  // PDU1 format: PS field is destination address, not part of PGN
+  if (PF < 240) PGN &= 0x3ff00;
+  FramesTotal++;
+  BitsTotal += Bits;
+  Bus.Frames++;
+  Bus.Bytes += len;
+  Bus.Bits += Bits;
+  tCounts &SourceCounts = Sources[Source].Period;
+  SourceCounts.Frames++;
+  SourceCounts.Bytes += len;
+  SourceCounts.Bits += Bits;
+  if (PGN == AddressClaimPGN) AddAddressClaim(Source, buf, len);
+  tEntry *pEntry = FindEntry(PGN, Source);
+  if (pEntry == 0) return;
+  pEntry->Period.Frames++;
+  pEntry->Period.Bytes += len;
+  pEntry->Period.Bits += Bits;
+  if (pEntry->FastPacket) AddFastPacketFrame(*pEntry, buf, len);
+}
+
+//*****************************************************************************
+void tBusAnalyzer::Report(tMetricsFile &Metrics, double Period_s) {
+  if (Period_s <= 0) Period_s = 1;
+  double BitsPerPeriod = BitRate * Period_s;
+  Metrics.Add("bus_load_ratio", Bus.Bits / BitsPerPeriod);
+  Metrics.Add("bus_frames_per_second", Bus.Frames / Period_s);
+  Metrics.Add("bus_bytes_per_second", Bus.Bytes / Period_s);
+  Metrics.Add("bus_frames_total", FramesTotal);
+  Metrics.Add("bus_bits_total", BitsTotal);
+  Metrics.Add("address_claims_total", ClaimsTotal);
+  Metrics.Add("address_claim_changes_total", ClaimChanges);
+  Metrics.Add("address_cannot_claim_total", CannotClaim);
+  Metrics.Add("analyzer_table_overflows_total", EntryOverflows);
+  memset(&Bus, 0, sizeof(Bus));
+  char Source[4];
+  char PGN[12];
+  for (int i = 0; i < 256; i++) {
+    tSource &Src = Sources[i];
+    if (Src.Period.Frames == 0 && Src.Claims == 0) continue;
+    snprintf(Source, sizeof(Source), "%d", i);
+    Metrics.Add("source_frames_per_second", "source", Source, Src.Period.Frames / Period_s);
+    Metrics.Add("source_bytes_per_second", "source", Source, Src.Period.Bytes / Period_s);
+    Metrics.Add("source_load_ratio", "source", Source, Src.Period.Bits / BitsPerPeriod);
+    if (Src.Claims > 0) Metrics.Add("source_address_claims_total", "source", Source, (uint64_t)Src.Claims);
+    memset(&Src.Period, 0, sizeof(Src.Period));
+  }
+  for (size_t i = 0; i < MaxEntries; i++) {
+    tEntry &Entry = Entries[i];
+    if (!Entry.Used) continue;
+    snprintf(Source, sizeof(Source), "%u", Entry.Source);
+    snprintf(PGN, sizeof(PGN), "%lu", Entry.PGN);
+    if (Entry.Period.Frames > 0) {
+      Metrics.Add("pgn_frames_per_second", "source", Source, "pgn", PGN, Entry.Period.Frames / Period_s);
+      Metrics.Add("pgn_bytes_per_second", "source", Source, "pgn", PGN, Entry.Period.Bytes / Period_s);
+    }
+    if (Entry.Complete > 0 || Entry.Incomplete > 0) {
+      Metrics.Add("fastpacket_complete_total", "source", Source, "pgn", PGN, Entry.Complete);
+      Metrics.Add("fastpacket_incomplete_total", "source", Source, "pgn", PGN, Entry.Incomplete);
+    }
+    memset(&Entry.Period, 0, sizeof(Entry.Period));
+  }
+}
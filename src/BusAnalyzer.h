@@ -0,0 +1,93 @@
+/*
+BusAnalyzer.h
+
+NMEA2000 bus load and per-device traffic analysis, fed with every frame
+received from or sent to the CAN socket. Tells apart a saturated bus, a
+chatty device and a slow converter.
+
+Bus time of each frame is calculated exactly: the 29-bit identifier
+frame is built bit by bit with its CRC, stuff bits are counted, and
+fixed fields (CRC delimiter, ACK, EOF, intermission) are added. Counts
+are kept per source address and per (source, PGN) in fixed tables, so no
+heap allocation happens after construction. Fast packet messages are
+followed per (source, PGN) to count complete and broken sequences, and
+address claims are followed per source to count claim churn.
+
+Report() writes rates over the last period (normally one second) and
+cumulative counters as metrics, bus totals first. Its metrics file needs
+ReportSize room.
+*/
+
+#ifndef BUS_ANALYZER_H
+#define BUS_ANALYZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Metrics.h"
+
+class tBusAnalyzer {
+public:
+  static const uint32_t BitRate=250000;
+  static const size_t MaxEntries=1024;
+  // Some room is kept free, so that probe sequences stay short
+  static const size_t MaxUsedEntries=MaxEntries*7/8;
+  // Metrics buffer for a report of full tables: up to four lines per source
+  // and per entry, and the bus totals
+  static const size_t ReportSize=(256*4 + MaxUsedEntries*4 + 16) * tMetricsFile::MaxLineLen;
+
+protected:
+  struct tCounts {
+    uint32_t Frames;
+    uint32_t Bytes;
+    uint32_t Bits;
+  };
+  struct tSource {
+    tCounts Period;
+    uint64_t Name;
+    uint32_t Claims;
+  };
+  // Traffic of one PGN from one source
+  struct tEntry {
+    unsigned long PGN;
+    uint8_t Source;
+    bool Used;
+    bool FastPacket;
+    // Fast packet sequence in progress
+    bool InProgress;
+    uint8_t Sequence;
+    uint8_t NextFrame;
+    uint8_t FramesExpected;
+    uint8_t BrokenSequence;
+    tCounts Period;
+    uint64_t Complete;
+    uint64_t Incomplete;
+  };
+
+  tCounts Bus;
+  uint64_t FramesTotal;
+  uint64_t BitsTotal;
+  tSource Sources[256];
+  tEntry Entries[MaxEntries];
+  size_t EntryCount;
+  uint64_t EntryOverflows;
+  uint64_t ClaimsTotal;
+  uint64_t ClaimChanges;
+  uint64_t CannotClaim;
+
+  tEntry* FindEntry(unsigned long PGN, uint8_t Source);
+  void AddFastPacketFrame(tEntry &Entry, const unsigned char *buf, unsigned char len);
+  void AddAddressClaim(uint8_t Source, const unsigned char *buf, unsigned char len);
+
+public:
+  tBusAnalyzer();
+  void AddFrame(unsigned long id, unsigned char len, const unsigned char *buf);
+  // Adds rates over Period_s and counters to Metrics, and starts a new period
+  void Report(tMetricsFile &Metrics, double Period_s);
+
+  // Bits a data frame with 29-bit identifier takes on the bus, including
+  // stuff bits and intermission
+  static uint32_t FrameBits(unsigned long id, unsigned char len, const unsigned char *buf);
+  static bool IsFastPacketPGN(unsigned long PGN);
+};
+
+#endif // BUS_ANALYZER_H
@@ -0,0 +1,86 @@
+/*
+CANUDP.cpp
+
+Wire format for CAN frames over UDP. See header for details.
+*/
+
+#include "CANUDP.h"
+#include <stdlib.h>
+#include <string.h>
+
+const size_t tCANUDP::HeaderSize;
+const size_t tCANUDP::FrameSize;
+const size_t tCANUDP::MaxFrames;
+const size_t tCANUDP::MaxDatagramSize;
+
+//*****************************************************************************
+static void PutUInt(uint8_t *Buf, uint64_t Value, int Bytes) {
+  for (int i = 0; i < Bytes; i++) {
+    Buf[i] = (uint8_t)(Value >> (8 * i));
+  }
+}
+
+//*****************************************************************************
+static uint64_t GetUInt(const uint8_t *Buf, int Bytes) {
+  uint64_t Value = 0;
+  for (int i = Bytes - 1; i >= 0; i--) {
+    Value = (Value << 8) | Buf[i];
+  }
+  return Value;
+}
+
+//*****************************************************************************
+void tCANUDP::EncodeHeader(uint8_t *Buf, const tCANUDPHeader &Header) {
+  PutUInt(Buf, Magic, 4);
+  Buf[4] = Version;
+  Buf[5] = Header.FrameCount;
+  PutUInt(Buf + 6, 0, 2);
+  PutUInt(Buf + 8, Header.Session, 4);
+  PutUInt(Buf + 12, Header.FirstSeq, 4);
+  PutUInt(Buf + 16, Header.KernelDrops, 4);
+}
+
+//*****************************************************************************
+void tCANUDP::EncodeFrame(uint8_t *Buf, size_t Index, const tCANUDPFrame &Frame) {
+  uint8_t *p = Buf + HeaderSize + Index * FrameSize;
+  PutUInt(p, Frame.Time_us, 8);
+  PutUInt(p + 8, Frame.Id, 4);
+  p[12] = Frame.Len;
+  memset(p + 13, 0, 3);
+  memcpy(p + 16, Frame.Data, 8);
+}
+
+//*****************************************************************************
+bool tCANUDP::DecodeHeader(const uint8_t *Buf, size_t Size, tCANUDPHeader &Header) {
+  if (Size < HeaderSize || GetUInt(Buf, 4) != Magic || Buf[4] != Version) return false;
+  Header.FrameCount = Buf[5];
+  if (Header.FrameCount > MaxFrames || Size != DatagramSize(Header.FrameCount)) return false;
+  Header.Session = GetUInt(Buf + 8, 4);
+  Header.FirstSeq = GetUInt(Buf + 12, 4);
+  Header.KernelDrops = GetUInt(Buf + 16, 4);
+  return true;
+}
+
+//*****************************************************************************
+void tCANUDP::DecodeFrame(const uint8_t *Buf, size_t Index, tCANUDPFrame &Frame) {
+  const uint8_t *p = Buf + HeaderSize + Index * FrameSize;
+  Frame.Time_us = GetUInt(p, 8);
+  Frame.Id = GetUInt(p + 8, 4) & 0x1fffffff;
+  Frame.Len = (p[12] > 8) ? 8 : p[12];
+  memcpy(Frame.Data, p + 16, 8);
+}
+
+//*****************************************************************************
+bool ParseHostPort(const char *Str, char *Host, size_t HostSize, uint16_t &Port) {
+  const char *Colon = strrchr(Str, ':');
+  const char *PortStr = Colon ? Colon + 1 : Str;
+  size_t HostLen = Colon ? (size_t)(Colon - Str) : 0;
+  if (HostLen >= HostSize) return false;
+  memcpy(Host, Str, HostLen);
+  Host[HostLen] = 0;
+  char *end;
+  unsigned long Value = strtoul(PortStr, &end, 10);
+  if (end == PortStr || *end != 0 || Value == 0 || Value > 65535) return false;
+  Port = (uint16_t)Value;
+  return true;
+}
@@ -0,0 +1,72 @@
+/*
+CANUDP.h
+
+Wire format for carrying CAN frames over UDP between a thin CAN bridge
+(n2kconvert --bridge) and a converter elsewhere on the network
+(n2kconvert --udpin). Frames are batched, many per datagram.
+
+Datagram, all fields little endian:
+
+  Header (20 bytes)
+    0  uint32  Magic "N2KU"
+    4  uint8   Version
+    5  uint8   Frame count
+    6  uint16  Reserved, 0
+    8  uint32  Session, random per bridge start
+    12 uint32  Sequence number of the first frame. Frames are numbered
+               consecutively, so the receiver can count lost frames.
+    16 uint32  Bridge CAN socket kernel drops, cumulative
+  Frames (24 bytes each)
+    0  uint64  Kernel receive time (us since 1970) on the bridge
+    8  uint32  29-bit CAN id
+    12 uint8   Data length
+    13         Reserved (3 bytes)
+    16 uint8[8] Data
+
+Up to MaxFrames frames keep a datagram within one Ethernet frame.
+*/
+
+#ifndef CAN_UDP_H
+#define CAN_UDP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct tCANUDPHeader {
+  uint8_t FrameCount;
+  uint32_t Session;
+  uint32_t FirstSeq;
+  uint32_t KernelDrops;
+};
+
+struct tCANUDPFrame {
+  uint64_t Time_us;
+  uint32_t Id;
+  uint8_t Len;
+  uint8_t Data[8];
+};
+
+class tCANUDP {
+public:
+  static const uint32_t Magic=0x554b324e; // "N2KU"
+  static const uint8_t Version=1;
+  static const size_t HeaderSize=20;
+  static const size_t FrameSize=24;
+  // 1472 bytes is the UDP payload of a 1500 byte Ethernet frame
+  static const size_t MaxFrames=(1472-HeaderSize)/FrameSize;
+  static const size_t MaxDatagramSize=HeaderSize+MaxFrames*FrameSize;
+
+  static size_t DatagramSize(uint8_t FrameCount) { return HeaderSize+FrameCount*FrameSize; }
+  // Encoding writes to Buf, which must hold the whole datagram
+  static void EncodeHeader(uint8_t *Buf, const tCANUDPHeader &Header);
+  static void EncodeFrame(uint8_t *Buf, size_t Index, const tCANUDPFrame &Frame);
+  // Returns false, if Buf is not a valid datagram of Size bytes
+  static bool DecodeHeader(const uint8_t *Buf, size_t Size, tCANUDPHeader &Header);
+  static void DecodeFrame(const uint8_t *Buf, size_t Index, tCANUDPFrame &Frame);
+};
+
+// Parses "host:port" or "port" into Host (empty if none) and Port.
+// Returns false on bad syntax.
+bool ParseHostPort(const char *Str, char *Host, size_t HostSize, uint16_t &Port);
+
+#endif // CAN_UDP_H
@@ -0,0 +1,200 @@
+/*
+CANUDPBridge.cpp
+
+Thin CAN to UDP bridge. See header for details.
+*/
+
+#include "CANUDPBridge.h"
+#include <iostream>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+using namespace std;
+
+const uint64_t tCANUDPBridge::FlushInterval_us;
+
+//*****************************************************************************
+tCANUDPBridge::tCANUDPBridge(const char *_Interface, const char *_Destination, int _RcvBufSize)
+  : Interface(_Interface), Destination(_Destination), RcvBufSize(_RcvBufSize), canfd(-1), udpfd(-1),
+    BatchStart_us(0), NextSeq(0), FramesForwarded(0), DatagramsSent(0), SendErrors(0), KernelDrops(0) {
+  // Session tells the receiver, when sequence starts over
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  Header.Session = (uint32_t)(now.tv_sec ^ now.tv_nsec ^ ((uint32_t)getpid() << 16));
+  Header.FrameCount = 0;
+  Header.FirstSeq = 0;
+  Header.KernelDrops = 0;
+}
+
+//*****************************************************************************
+tCANUDPBridge::~tCANUDPBridge() {
+  if (canfd >= 0) close(canfd);
+  if (udpfd >= 0) close(udpfd);
+}
+
+//*****************************************************************************
+void tCANUDPBridge::GetStats(tStats &Stats) const {
+  Stats.FramesForwarded = FramesForwarded;
+  Stats.DatagramsSent = DatagramsSent;
+  Stats.SendErrors = SendErrors;
+  Stats.KernelDrops = KernelDrops;
+}
+
+//*****************************************************************************
+uint64_t tCANUDPBridge::Monotonic_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+//*****************************************************************************
+bool tCANUDPBridge::Open() {
+  return OpenCAN() && OpenUDP();
+}
+
+//*****************************************************************************
+bool tCANUDPBridge::OpenCAN() {
+  canfd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+  if (canfd < 0) {
+    cerr << "Cannot open CAN socket: " << strerror(errno) << "\n";
+    return false;
+  }
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, Interface.c_str(), IFNAMSIZ - 1);
+  if (ioctl(canfd, SIOCGIFINDEX, &ifr) < 0) {
+    cerr << "Cannot find CAN interface " << Interface << ": " << strerror(errno) << "\n";
+    return false;
+  }
+  struct sockaddr_can addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(canfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    cerr << "Cannot bind to CAN interface " << Interface << ": " << strerror(errno) << "\n";
+    return false;
+  }
+  int on = 1;
+  setsockopt(canfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+  setsockopt(canfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+  if (RcvBufSize > 0 && setsockopt(canfd, SOL_SOCKET, SO_RCVBUF, &RcvBufSize, sizeof(RcvBufSize)) < 0) {
+    cerr << "Cannot set CAN socket receive buffer: " << strerror(errno) << "\n";
+  }
+  return true;
+}
+
+//*****************************************************************************
+bool tCANUDPBridge::OpenUDP() {
+  char Host[256];
+  char Port[8];
+  uint16_t PortNum;
+  if (!ParseHostPort(Destination.c_str(), Host, sizeof(Host), PortNum) || Host[0] == 0) {
+    cerr << "Bad bridge destination, host:port expected: " << Destination << "\n";
+    return false;
+  }
+  snprintf(Port, sizeof(Port), "%u", PortNum);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  struct addrinfo *res;
+  int err = getaddrinfo(Host, Port, &hints, &res);
+  if (err != 0) {
+    cerr << "Cannot resolve bridge destination " << Host << ": " << gai_strerror(err) << "\n";
+    return false;
+  }
+  udpfd = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  bool ok = (udpfd >= 0 && connect(udpfd, res->ai_addr, res->ai_addrlen) == 0);
+  if (!ok) cerr << "Cannot open UDP socket to " << Destination << ": " << strerror(errno) << "\n";
+  freeaddrinfo(res);
+  return ok;
+}
+
+//*****************************************************************************
+bool tCANUDPBridge::ReadFrame(tCANUDPFrame &Frame) {
+  struct can_frame frame;
+  struct iovec iov;
+  struct msghdr msg;
+  char ctrl[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timespec))];
+  iov.iov_base = &frame;
+  iov.iov_len = sizeof(frame);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  while (true) {
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if (recvmsg(canfd, &msg, MSG_DONTWAIT) != sizeof(frame)) return false;
+    struct timespec Time;
+    bool Stamped = false;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != 0; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        memcpy(&KernelDrops, CMSG_DATA(cmsg), sizeof(KernelDrops));
+      } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        memcpy(&Time, CMSG_DATA(cmsg), sizeof(Time));
+        Stamped = true;
+      }
+    }
+    // NMEA2000 only uses extended data frames
+    if ((frame.can_id & CAN_EFF_FLAG) == 0 || (frame.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0) continue;
+    if (!Stamped) clock_gettime(CLOCK_REALTIME, &Time);
+    Frame.Time_us = (uint64_t)Time.tv_sec * 1000000 + Time.tv_nsec / 1000;
+    Frame.Id = frame.can_id & CAN_EFF_MASK;
+    Frame.Len = (frame.can_dlc > 8) ? 8 : frame.can_dlc;
+    memset(Frame.Data, 0, sizeof(Frame.Data));
+    memcpy(Frame.Data, frame.data, Frame.Len);
+    return true;
+  }
+}
+
+//*****************************************************************************
+void tCANUDPBridge::Flush() {
+  if (Header.FrameCount == 0) return;
+  Header.KernelDrops = KernelDrops;
+  tCANUDP::EncodeHeader(Batch, Header);
+  size_t Size = tCANUDP::DatagramSize(Header.FrameCount);
+  // Receiver counts frames of datagrams that could not be sent as lost
+  if (send(udpfd, Batch, Size, MSG_NOSIGNAL) == (ssize_t)Size) {
+    DatagramsSent++;
+  } else {
+    SendErrors++;
+  }
+  NextSeq += Header.FrameCount;
+  Header.FrameCount = 0;
+}
+
+//*****************************************************************************
+void tCANUDPBridge::Poll(int Timeout_ms) {
+  // Do not sleep past the flush time of a pending batch
+  if (Header.FrameCount > 0) {
+    uint64_t Elapsed_us = Monotonic_us() - BatchStart_us;
+    int Flush_ms = (Elapsed_us >= FlushInterval_us) ? 0 : (FlushInterval_us - Elapsed_us + 999) / 1000;
+    if (Flush_ms < Timeout_ms) Timeout_ms = Flush_ms;
+  }
+  struct pollfd pfd;
+  pfd.fd = canfd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  poll(&pfd, 1, Timeout_ms);
+  tCANUDPFrame Frame;
+  while (ReadFrame(Frame)) {
+    if (Header.FrameCount == 0) {
+      Header.FirstSeq = NextSeq;
+      BatchStart_us = Monotonic_us();
+    }
+    tCANUDP::EncodeFrame(Batch, Header.FrameCount++, Frame);
+    FramesForwarded++;
+    if (Header.FrameCount == tCANUDP::MaxFrames) Flush();
+  }
+  if (Header.FrameCount > 0 && Monotonic_us() - BatchStart_us >= FlushInterval_us) Flush();
+}
@@ -0,0 +1,64 @@
+/*
+CANUDPBridge.h
+
+Thin CAN to UDP bridge: reads frames from a SocketCAN port and sends them
+in batches to a converter running tNMEA2000_CANUDP (see CANUDP.h). Nothing
+is parsed, so it is light enough for a small CAN host.
+
+A batch is sent when it is full or FlushInterval_us after its first frame,
+which bounds the added latency.
+*/
+
+#ifndef CAN_UDP_BRIDGE_H
+#define CAN_UDP_BRIDGE_H
+
+#include <stdint.h>
+#include <string>
+#include "CANUDP.h"
+
+class tCANUDPBridge {
+public:
+  struct tStats {
+    uint64_t FramesForwarded;
+    uint64_t DatagramsSent;
+    uint64_t SendErrors;
+    uint64_t KernelDrops;
+  };
+
+protected:
+  static const uint64_t FlushInterval_us=5000;
+
+  std::string Interface;
+  std::string Destination;
+  int RcvBufSize;
+  int canfd;
+  int udpfd;
+  tCANUDPHeader Header;
+  uint8_t Batch[tCANUDP::MaxDatagramSize];
+  uint64_t BatchStart_us;
+  uint32_t NextSeq;
+
+  uint64_t FramesForwarded;
+  uint64_t DatagramsSent;
+  uint64_t SendErrors;
+  uint32_t KernelDrops;
+
+  bool OpenCAN();
+  bool OpenUDP();
+  bool ReadFrame(tCANUDPFrame &Frame);
+  void Flush();
+  static uint64_t Monotonic_us();
+
+public:
+  // _Destination is "host:port" of the converter, _RcvBufSize CAN socket
+  // receive buffer size in bytes, 0 for system default
+  tCANUDPBridge(const char *_Interface, const char *_Destination, int _RcvBufSize=0);
+  ~tCANUDPBridge();
+  bool Open();
+  // Waits up to Timeout_ms for frames and forwards them. Returns early on
+  // signals, so the caller can check whether to stop.
+  void Poll(int Timeout_ms);
+  void GetStats(tStats &Stats) const;
+};
+
+#endif // CAN_UDP_BRIDGE_H
@@ -0,0 +1,177 @@
+/*
+ColumnWriter.cpp
+
+Time series of decoded values in a columnar file. See header for details.
+*/
+
+#include "ColumnWriter.h"
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char ColumnMagic[8] = { 'N','2','K','C','O','L','1',0 };
+static const uint32_t ColumnVersion = 1;
+
+//*****************************************************************************
+static void PutLE32(uint8_t *p, uint32_t Value) {
+  for (int i = 0; i < 4; i++, Value >>= 8) p[i] = (uint8_t)Value;
+}
+
+static void PutLE64(uint8_t *p, uint64_t Value) {
+  for (int i = 0; i < 8; i++, Value >>= 8) p[i] = (uint8_t)Value;
+}
+
+static void PutDouble(uint8_t *p, double Value) {
+  uint64_t Bits;
+  memcpy(&Bits, &Value, sizeof(Bits));
+  PutLE64(p, Bits);
+}
+
+//*****************************************************************************
+tColumnWriter::tColumnWriter() : fd(-1), ColumnCount(0), BlockSize(0), BlockIndex(0),
+    Rows(0), UnflushedRows(0), MinTime(0), MaxTime(0) {
+  memset(&Stats, 0, sizeof(Stats));
+}
+
+//*****************************************************************************
+tColumnWriter::~tColumnWriter() {
+  Close();
+}
+
+//*****************************************************************************
+bool tColumnWriter::Open(const char *Path, const char * const *Names, uint32_t Count) {
+  Close();
+  if (Count + 1 > MaxColumns) {
+    std::cerr << "Too many columns for " << Path << "\n";
+    return false;
+  }
+  ColumnCount = Count + 1;
+  BlockSize = PageSize * (1 + ColumnCount);
+  uint8_t Header[HeaderSize];
+  memset(Header, 0, sizeof(Header));
+  memcpy(Header, ColumnMagic, sizeof(ColumnMagic));
+  PutLE32(Header + 8, ColumnVersion);
+  PutLE32(Header + 12, ColumnCount);
+  PutLE32(Header + 16, BlockRows);
+  PutLE32(Header + 20, BlockSize);
+  PutLE32(Header + 24, HeaderSize);
+  for (uint32_t c = 0; c < ColumnCount; c++) {
+    uint8_t *Desc = Header + 64 + c * 32;
+    strncpy((char *)Desc, c == 0 ? "time" : Names[c - 1], NameSize - 1);
+    Desc[NameSize] = (c == 0) ? ct_Int64 : ct_Float64;
+  }
+
+  fd = open(Path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << "Cannot open column file " << Path << "\n";
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    Close();
+    return false;
+  }
+  if (st.st_size == 0) {
+    if (pwrite(fd, Header, HeaderSize, 0) != (ssize_t)HeaderSize) {
+      std::cerr << "Cannot write column file " << Path << "\n";
+      Close();
+      return false;
+    }
+    BlockIndex = 0;
+  } else {
+    // Append only to a file with the same columns
+    uint8_t OldHeader[HeaderSize];
+    if (pread(fd, OldHeader, HeaderSize, 0) != (ssize_t)HeaderSize ||
+        memcmp(OldHeader, Header, HeaderSize) != 0) {
+      std::cerr << "Column file " << Path << " has different format or columns\n";
+      Close();
+      return false;
+    }
+    BlockIndex = (st.st_size - HeaderSize + BlockSize - 1) / BlockSize;
+  }
+  Block.assign(BlockSize, 0);
+  Min.assign(ColumnCount, NAN);
+  Max.assign(ColumnCount, NAN);
+  ClearBlock();
+  return true;
+}
+
+//*****************************************************************************
+void tColumnWriter::Close() {
+  if (fd < 0) return;
+  if (UnflushedRows > 0) Flush();
+  close(fd);
+  fd = -1;
+}
+
+//*****************************************************************************
+void tColumnWriter::ClearBlock() {
+  Rows = 0;
+  UnflushedRows = 0;
+  memset(Block.data(), 0, BlockSize);
+  for (uint32_t c = 0; c < ColumnCount; c++) {
+    Min[c] = Max[c] = NAN;
+  }
+  // Float columns are padded with NaN, time column with zero
+  uint8_t NaN[8];
+  PutDouble(NaN, NAN);
+  for (uint32_t c = 1; c < ColumnCount; c++) {
+    uint8_t *Column = Block.data() + PageSize * (1 + c);
+    for (uint32_t i = 0; i < BlockRows; i++) memcpy(Column + i * 8, NaN, 8);
+  }
+}
+
+//*****************************************************************************
+void tColumnWriter::AddRow(int64_t Time_us, const double *Values) {
+  if (fd < 0) return;
+  uint8_t *Data = Block.data() + PageSize;
+  PutLE64(Data + Rows * 8, (uint64_t)Time_us);
+  if (Rows == 0 || Time_us < MinTime) MinTime = Time_us;
+  if (Rows == 0 || Time_us > MaxTime) MaxTime = Time_us;
+  for (uint32_t c = 1; c < ColumnCount; c++) {
+    double Value = Values[c - 1];
+    PutDouble(Data + c * PageSize + Rows * 8, Value);
+    if (isnan(Value)) continue;
+    if (isnan(Min[c]) || Value < Min[c]) Min[c] = Value;
+    if (isnan(Max[c]) || Value > Max[c]) Max[c] = Value;
+  }
+  Rows++;
+  UnflushedRows++;
+  Stats.Rows++;
+  if (Rows == BlockRows) {
+    Flush();
+    BlockIndex++;
+    Stats.Blocks++;
+    ClearBlock();
+  } else if (UnflushedRows >= FlushRows) {
+    Flush();
+  }
+}
+
+//*****************************************************************************
+bool tColumnWriter::Flush() {
+  if (fd < 0 || Rows == 0) return true;
+  return WriteBlock();
+}
+
+//*****************************************************************************
+bool tColumnWriter::WriteBlock() {
+  uint8_t *Header = Block.data();
+  PutLE32(Header, Rows);
+  PutLE64(Header + 8, (uint64_t)MinTime);
+  PutLE64(Header + 16, (uint64_t)MaxTime);
+  for (uint32_t c = 1; c < ColumnCount; c++) {
+    PutDouble(Header + 8 + c * 16, Min[c]);
+    PutDouble(Header + 16 + c * 16, Max[c]);
+  }
+  UnflushedRows = 0;
+  off_t Offset = (off_t)HeaderSize + (off_t)BlockIndex * BlockSize;
+  if (pwrite(fd, Block.data(), BlockSize, Offset) != (ssize_t)BlockSize) {
+    Stats.WriteErrors++;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,91 @@
+/*
+ColumnWriter.h
+
+Time series of decoded values in a columnar file, for analysis tools which
+would otherwise re-parse NMEA0183 logs. Values are stored as they are
+decoded, without the precision loss of 0183 formatting.
+
+File layout, all values little-endian, all parts page (4096 byte) aligned
+so that any block or column can be mmapped on its own:
+
+  File header (4096 bytes)
+    0   char[8]   magic "N2KCOL1\0"
+    8   uint32    format version (1)
+    12  uint32    column count, including time column
+    16  uint32    rows per block (512)
+    20  uint32    block size in bytes
+    24  uint32    header size in bytes (offset of first block)
+    64  column descriptors, 32 bytes each:
+          char[24] name (NUL padded), uint8 type (0 int64, 1 float64)
+
+  Blocks, block i at header size + i * block size
+    0   uint32    rows used in block
+    8   per column min and max of the block (16 bytes), NaN if no values
+    4096          column data, one page (512 values) per column
+
+Column 0 is time, int64 microseconds since 1970 UTC. Other columns are
+float64 with NaN for not available. A reader can skip blocks by reading
+only their first page. Blocks can be partly filled (the last one, and the
+last one written before an append or merge); rows beyond the row count are
+padding. Files with the same columns can be merged by appending blocks.
+
+The block being filled is rewritten in place every FlushRows rows, so a
+crash loses at most that many rows. An existing file with the same
+columns is appended to, starting from a new block.
+*/
+
+#ifndef COLUMN_WRITER_H
+#define COLUMN_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class tColumnWriter {
+public:
+  static const uint32_t PageSize=4096;
+  static const uint32_t HeaderSize=PageSize;
+  static const uint32_t BlockRows=PageSize/8;
+  static const uint32_t NameSize=24;
+  static const uint32_t MaxColumns=(HeaderSize-64)/32;
+  static const uint32_t FlushRows=64;
+  enum tColumnType { ct_Int64=0, ct_Float64=1 };
+
+  struct tStats {
+    uint64_t Rows;
+    uint64_t Blocks;
+    uint64_t WriteErrors;
+  };
+
+protected:
+  int fd;
+  uint32_t ColumnCount;
+  uint32_t BlockSize;
+  uint64_t BlockIndex;
+  uint32_t Rows;
+  uint32_t UnflushedRows;
+  std::vector<uint8_t> Block;
+  int64_t MinTime;
+  int64_t MaxTime;
+  std::vector<double> Min;
+  std::vector<double> Max;
+  tStats Stats;
+
+  void ClearBlock();
+  bool WriteBlock();
+
+public:
+  tColumnWriter();
+  ~tColumnWriter();
+  // Creates or appends to file with time column and float64 columns Names
+  bool Open(const char *Path, const char * const *Names, uint32_t Count);
+  void Close();
+  bool IsOpen() const { return fd>=0; }
+  // Values has one value for each float64 column, NaN for not available
+  void AddRow(int64_t Time_us, const double *Values);
+  // Writes the block being filled
+  bool Flush();
+  void GetStats(tStats &_Stats) const { _Stats=Stats; }
+};
+
+#endif // COLUMN_WRITER_H
@@ -0,0 +1,87 @@
+/*
+HeapGuard.cpp
+
+Heap allocation accounting. See header for details.
+*/
+
+#include "HeapGuard.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static std::atomic<uint64_t> TotalAllocations(0);
+static std::atomic<uint64_t> SteadyAllocations(0);
+static std::atomic<int> GuardMode(hgm_Off);
+static std::atomic<bool> SteadyState(false);
+
+//*****************************************************************************
+bool ParseHeapGuardMode(const char *Str, tHeapGuardMode &Mode) {
+  if (strcmp(Str, "off") == 0) Mode = hgm_Off;
+  else if (strcmp(Str, "count") == 0) Mode = hgm_Count;
+  else if (strcmp(Str, "trap") == 0) Mode = hgm_Trap;
+  else return false;
+  return true;
+}
+
+//*****************************************************************************
+void HeapGuardSetSteadyState(tHeapGuardMode Mode) {
+  GuardMode = Mode;
+  SteadyAllocations = 0;
+  SteadyState = (Mode != hgm_Off);
+}
+
+//*****************************************************************************
+uint64_t HeapGuardSteadyAllocations() {
+  return SteadyAllocations;
+}
+
+//*****************************************************************************
+uint64_t HeapGuardTotalAllocations() {
+  return TotalAllocations;
+}
+
+//*****************************************************************************
+// Must not allocate itself, so no iostreams here
+static void* GuardedAlloc(size_t Size) {
+  TotalAllocations++;
+  if (SteadyState) {
+    SteadyAllocations++;
+    if (GuardMode == hgm_Trap) {
+      static const char Msg[] = "HeapGuard: heap allocation after steady state, aborting.\n";
+      ssize_t res = write(STDERR_FILENO, Msg, sizeof(Msg) - 1);
+      (void)res;
+      abort();
+    }
+  }
+  return malloc(Size ? Size : 1);
+}
+
+//*****************************************************************************
+void* operator new(size_t Size) {
+  void *p = GuardedAlloc(Size);
+  if (p == 0) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t Size) {
+  void *p = GuardedAlloc(Size);
+  if (p == 0) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new(size_t Size, const std::nothrow_t&) noexcept {
+  return GuardedAlloc(Size);
+}
+
+void* operator new[](size_t Size, const std::nothrow_t&) noexcept {
+  return GuardedAlloc(Size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { free(p); }
@@ -0,0 +1,31 @@
+/*
+HeapGuard.h
+
+Heap allocation accounting. Replaces global operator new/delete, so that
+allocations made after the program reached its steady state (main loop
+running) can be counted or trapped. Everything the main loop needs should
+be allocated at startup; a late allocation means something will slowly
+fragment the heap over weeks of uptime.
+*/
+
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <stdint.h>
+
+enum tHeapGuardMode {
+  hgm_Off,   // Count only total allocations
+  hgm_Count, // Count allocations after steady state
+  hgm_Trap   // Abort on first allocation after steady state
+};
+
+// Parses "off", "count" or "trap". Returns false on unknown mode.
+bool ParseHeapGuardMode(const char *Str, tHeapGuardMode &Mode);
+// Marks the point after which allocations are counted/trapped
+void HeapGuardSetSteadyState(tHeapGuardMode Mode);
+// Allocations made since the steady state point
+uint64_t HeapGuardSteadyAllocations();
+// Allocations made since program start
+uint64_t HeapGuardTotalAllocations();
+
+#endif // HEAP_GUARD_H
@@ -0,0 +1,56 @@
+/*
+LatencyHistogram.cpp
+
+Fixed size log-linear latency histogram. See header for details.
+*/
+
+#include "LatencyHistogram.h"
+#include <string.h>
+
+//*****************************************************************************
+uint32_t tLatencyHistogram::BucketIndex(uint32_t Value) {
+  if (Value < LinearLimit) return Value;
+  uint32_t Exponent = 31 - __builtin_clz(Value); // >= 5
+  uint32_t Sub = (Value >> (Exponent - SubBucketBits)) & (SubBuckets - 1);
+  return LinearLimit + (Exponent - 5) * SubBuckets + Sub;
+}
+
+//*****************************************************************************
+uint32_t tLatencyHistogram::BucketValue(uint32_t Index) {
+  if (Index < LinearLimit) return Index;
+  uint32_t Exponent = (Index - LinearLimit) / SubBuckets + 5;
+  uint32_t Sub = (Index - LinearLimit) % SubBuckets;
+  return (1u << Exponent) | (Sub << (Exponent - SubBucketBits));
+}
+
+//*****************************************************************************
+void tLatencyHistogram::Reset() {
+  memset(Counts, 0, sizeof(Counts));
+  Count = 0;
+  Sum = 0;
+  Max = 0;
+}
+
+//*****************************************************************************
+void tLatencyHistogram::Add(uint32_t Value_us) {
+  Counts[BucketIndex(Value_us)]++;
+  Count++;
+  Sum += Value_us;
+  if (Value_us > Max) Max = Value_us;
+}
+
+//*****************************************************************************
+uint32_t tLatencyHistogram::GetPercentile(double Percentile) const {
+  if (Count == 0) return 0;
+  uint64_t Target = (uint64_t)(Percentile / 100.0 * Count);
+  if (Target >= Count) Target = Count - 1;
+  uint64_t Seen = 0;
+  for (uint32_t i = 0; i < Buckets; i++) {
+    Seen += Counts[i];
+    if (Seen > Target) {
+      uint32_t Value = BucketValue(i);
+      return (Value > Max) ? Max : Value;
+    }
+  }
+  return Max;
+}
@@ -0,0 +1,42 @@
+/*
+LatencyHistogram.h
+
+Fixed size log-linear histogram for latency measurements in microseconds.
+Recording is constant time and allocation free, percentiles are accurate
+to about 6%.
+*/
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+class tLatencyHistogram {
+protected:
+  // Values below LinearLimit get their own bucket, above that each power of
+  // two is split into SubBuckets.
+  static const uint32_t LinearLimit=32;
+  static const uint32_t SubBucketBits=4;
+  static const uint32_t SubBuckets=1<<SubBucketBits;
+  static const uint32_t Buckets=LinearLimit+(32-5)*SubBuckets;
+
+  uint32_t Counts[Buckets];
+  uint64_t Count;
+  uint64_t Sum;
+  uint32_t Max;
+
+  static uint32_t BucketIndex(uint32_t Value);
+  static uint32_t BucketValue(uint32_t Index);
+
+public:
+  tLatencyHistogram() { Reset(); }
+  void Reset();
+  void Add(uint32_t Value_us);
+  uint64_t GetCount() const { return Count; }
+  uint32_t GetMax() const { return Max; }
+  double GetMean() const { return Count ? (double)Sum / Count : 0.0; }
+  // Percentile (0-100) in microseconds, rounded down to the bucket boundary
+  uint32_t GetPercentile(double Percentile) const;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,90 @@
+/*
+LoopMonitor.cpp
+
+Deadline monitoring for the conversion loop. See header for details.
+*/
+
+#include "LoopMonitor.h"
+#include <iostream>
+
+using namespace std;
+
+const int tLoopMonitor::LogPeriod_s;
+const uint32_t tLoopMonitor::StallLimit_us;
+
+//*****************************************************************************
+tLoopMonitor::tLoopMonitor(uint32_t _Budget_us)
+  : Budget_us(_Budget_us), IterationStart(tClock::now()), OverrunStage(0), OverrunPGN(0),
+    OverrunAt_us(0), Iterations(0), Overruns(0), MissedSlots(0), Unlogged(0),
+    LastLog(IterationStart), Logged(false), CompletedIterations(0) {
+}
+
+//*****************************************************************************
+uint32_t tLoopMonitor::Elapsed_us(tClock::time_point Now) const {
+  return chrono::duration_cast<chrono::microseconds>(Now - IterationStart).count();
+}
+
+//*****************************************************************************
+// Woke up late by a whole budget or more means slots were missed
+void tLoopMonitor::BeginIteration(uint32_t WakeLate_us) {
+  IterationStart = tClock::now();
+  OverrunStage = 0;
+  OverrunPGN = 0;
+  WakeLate.Add(WakeLate_us);
+  MissedSlots += WakeLate_us / Budget_us;
+}
+
+//*****************************************************************************
+void tLoopMonitor::CheckBudget(const char *Stage, unsigned long PGN) {
+  uint32_t Elapsed = Elapsed_us(tClock::now());
+  if (Elapsed <= Budget_us) return;
+  OverrunStage = Stage;
+  OverrunPGN = PGN;
+  OverrunAt_us = Elapsed;
+}
+
+//*****************************************************************************
+void tLoopMonitor::EndIteration() {
+  tClock::time_point Now = tClock::now();
+  uint32_t Busy_us = Elapsed_us(Now);
+  Iterations++;
+  Busy.Add(Busy_us);
+  if (Busy_us <= StallLimit_us) CompletedIterations++;
+  if (Busy_us <= Budget_us) return;
+  Overruns++;
+  if (!Logged || Now - LastLog >= chrono::seconds(LogPeriod_s)) {
+    LogOverrun(Busy_us, Now);
+  } else {
+    Unlogged++;
+  }
+}
+
+//*****************************************************************************
+void tLoopMonitor::LogOverrun(uint32_t Busy_us, tClock::time_point Now) {
+  cerr << "Loop overran its " << Budget_us / 1000 << "ms budget: busy " << Busy_us / 1000 << "ms";
+  if (OverrunStage != 0) {
+    cerr << ", budget exceeded at " << OverrunAt_us / 1000 << "ms in " << OverrunStage;
+    if (OverrunPGN != 0) cerr << " " << OverrunPGN;
+  }
+  if (Unlogged > 0) {
+    cerr << " (" << Unlogged << " more overruns since last report)";
+  }
+  cerr << "\n";
+  Unlogged = 0;
+  LastLog = Now;
+  Logged = true;
+}
+
+//*****************************************************************************
+bool tLoopMonitor::TakeProgress() {
+  bool Progress = (CompletedIterations > 0);
+  CompletedIterations = 0;
+  return Progress;
+}
+
+//*****************************************************************************
+void tLoopMonitor::GetStats(tStats &Stats) const {
+  Stats.Iterations = Iterations;
+  Stats.Overruns = Overruns;
+  Stats.MissedSlots = MissedSlots;
+}
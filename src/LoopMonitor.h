@@ -0,0 +1,83 @@
+/*
+LoopMonitor.h
+
+Deadline monitoring for the 50 ms conversion loop. Each iteration should
+be done well inside its slot. The monitor measures how long an iteration
+was busy, counts overruns and slots missed because the loop woke up too
+late, and finds out what was running when the budget ran out: the loop
+and the converter call Checkpoint() after each piece of work, and the
+first checkpoint past the budget is blamed for the overrun.
+
+Overruns are logged at most once per LogPeriod_s, with the count of those
+not logged in between. Recording is allocation free.
+
+A slow loop is not a stuck one: progress for the watchdog is any pass
+finishing within StallLimit_us, far above the budget, so a converter
+running late through a traffic burst is not restarted.
+*/
+
+#ifndef LOOP_MONITOR_H
+#define LOOP_MONITOR_H
+
+#include <chrono>
+#include <stdint.h>
+#include "LatencyHistogram.h"
+
+class tLoopMonitor {
+public:
+  using tClock=std::chrono::steady_clock;
+  struct tStats {
+    uint64_t Iterations;
+    uint64_t Overruns;
+    uint64_t MissedSlots;
+  };
+
+protected:
+  static const int LogPeriod_s=10;
+  // Pass busy longer than this is not counted as progress
+  static const uint32_t StallLimit_us=1000000;
+
+  uint32_t Budget_us;
+  tClock::time_point IterationStart;
+  // What was running, when the budget ran out in this iteration
+  const char *OverrunStage;
+  unsigned long OverrunPGN;
+  uint32_t OverrunAt_us;
+  // Counters
+  uint64_t Iterations;
+  uint64_t Overruns;
+  uint64_t MissedSlots;
+  uint64_t Unlogged;
+  tClock::time_point LastLog;
+  bool Logged;
+  // Iterations within stall limit since last TakeProgress()
+  uint64_t CompletedIterations;
+  tLatencyHistogram Busy;
+  tLatencyHistogram WakeLate;
+
+  uint32_t Elapsed_us(tClock::time_point Now) const;
+  void CheckBudget(const char *Stage, unsigned long PGN);
+  void LogOverrun(uint32_t Busy_us, tClock::time_point Now);
+
+public:
+  tLoopMonitor(uint32_t _Budget_us);
+  // WakeLate_us is how late the loop woke up for this slot
+  void BeginIteration(uint32_t WakeLate_us);
+  // Called after a piece of work (stage name must be a literal), and after
+  // each converted message with its PGN
+  void Checkpoint(const char *Stage, unsigned long PGN=0) {
+    if (OverrunStage == 0) CheckBudget(Stage, PGN);
+  }
+  void EndIteration();
+  // Whether some iteration finished within stall limit since last call.
+  // Used to decide, if the watchdog may be told we are alive.
+  bool TakeProgress();
+
+  void GetStats(tStats &Stats) const;
+  const tLatencyHistogram& GetBusyHistogram() const { return Busy; }
+  const tLatencyHistogram& GetWakeLateHistogram() const { return WakeLate; }
+  // Histograms cover one reporting period
+  void ResetHistograms() { Busy.Reset(); WakeLate.Reset(); }
+};
+
+#endif // LOOP_MONITOR_H
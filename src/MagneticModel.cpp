@@ -0,0 +1,166 @@
+/*
+MagneticModel.cpp
+
+Magnetic variation from the World Magnetic Model. See header for details.
+
+Field is calculated in geocentric spherical coordinates with Gauss
+normalized associated Legendre functions (coefficients converted from
+Schmidt semi-normalization), then rotated to the geodetic frame.
+*/
+
+#include "MagneticModel.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <math.h>
+
+using namespace std;
+
+const double tMagneticModel::GridStep_deg=0.05;
+
+// WGS84 ellipsoid and geomagnetic reference radius (km)
+static const double WGS84A = 6378.137;
+static const double WGS84F = 1.0 / 298.257223563;
+static const double GeomagRefRadius = 6371.2;
+static const double DegToRad = M_PI / 180.0;
+
+//*****************************************************************************
+tMagneticModel::tMagneticModel()
+  : Epoch(0), Degree(0), CacheValid(false), CacheLatitudeCell(0), CacheLongitudeCell(0),
+    CacheDaysSince1970(0), CacheVariation(0), Evaluations(0) {
+  for (int n = 0; n <= MaxDegree; n++) {
+    for (int m = 0; m <= MaxDegree; m++) {
+      g[n][m] = h[n][m] = gdot[n][m] = hdot[n][m] = 0;
+    }
+  }
+}
+
+//*****************************************************************************
+bool tMagneticModel::Load(const char *FileName) {
+  ifstream File(FileName);
+  if (!File) {
+    cerr << "Cannot open magnetic model file: " << FileName << "\n";
+    return false;
+  }
+  string Line;
+  // Header: epoch, model name, release date
+  if (!getline(File, Line) || !(istringstream(Line) >> Epoch)) {
+    cerr << "Bad magnetic model file header: " << FileName << "\n";
+    return false;
+  }
+  Degree = 0;
+  while (getline(File, Line)) {
+    // File ends with a line of 9s
+    if (Line.find("9999") != string::npos) break;
+    int n, m;
+    double _g, _h, _gdot, _hdot;
+    if (!(istringstream(Line) >> n >> m >> _g >> _h >> _gdot >> _hdot)) continue;
+    if (n < 1 || n > MaxDegree || m < 0 || m > n) continue;
+    g[n][m] = _g;
+    h[n][m] = _h;
+    gdot[n][m] = _gdot;
+    hdot[n][m] = _hdot;
+    if (n > Degree) Degree = n;
+  }
+  if (Degree == 0) {
+    cerr << "No coefficients in magnetic model file: " << FileName << "\n";
+    return false;
+  }
+  CacheValid = false;
+  return true;
+}
+
+//*****************************************************************************
+double tMagneticModel::CalcDeclination(double Latitude, double Longitude, double Altitude, double DecimalYear) const {
+  if (Degree == 0) return 0;
+  // Model is undefined at the poles
+  if (Latitude > 89.999) Latitude = 89.999;
+  if (Latitude < -89.999) Latitude = -89.999;
+  // Geodetic to geocentric spherical
+  double e2 = WGS84F * (2.0 - WGS84F);
+  double Lat = Latitude * DegToRad;
+  double Lon = Longitude * DegToRad;
+  double Alt = Altitude / 1000.0;
+  double SinLat = sin(Lat);
+  double Rc = WGS84A / sqrt(1.0 - e2 * SinLat * SinLat);
+  double p = (Rc + Alt) * cos(Lat);
+  double z = (Rc * (1.0 - e2) + Alt) * SinLat;
+  double r = sqrt(p * p + z * z);
+  double LatGeocentric = asin(z / r);
+  double CosTheta = sin(LatGeocentric);
+  double SinTheta = cos(LatGeocentric);
+  double dt = DecimalYear - Epoch;
+
+  // Gauss normalized Legendre functions and their derivatives by colatitude,
+  // with Schmidt to Gauss conversion factors S
+  double P[MaxDegree+1][MaxDegree+1];
+  double dP[MaxDegree+1][MaxDegree+1];
+  double S[MaxDegree+1][MaxDegree+1];
+  P[0][0] = 1;
+  dP[0][0] = 0;
+  S[0][0] = 1;
+  double Br = 0, Btheta = 0, Bphi = 0;
+  double RatioPow = (GeomagRefRadius / r) * (GeomagRefRadius / r);
+  for (int n = 1; n <= Degree; n++) {
+    RatioPow *= GeomagRefRadius / r;
+    for (int m = 0; m <= n; m++) {
+      if (m == n) {
+        P[n][m] = SinTheta * P[n-1][m-1];
+        dP[n][m] = SinTheta * dP[n-1][m-1] + CosTheta * P[n-1][m-1];
+      } else {
+        P[n][m] = CosTheta * P[n-1][m];
+        dP[n][m] = CosTheta * dP[n-1][m] - SinTheta * P[n-1][m];
+        if (m <= n-2) {
+          double K = (double)((n-1)*(n-1) - m*m) / ((2*n-1)*(2*n-3));
+          P[n][m] -= K * P[n-2][m];
+          dP[n][m] -= K * dP[n-2][m];
+        }
+      }
+      if (m == 0) {
+        S[n][0] = S[n-1][0] * (2*n-1) / n;
+      } else {
+        S[n][m] = S[n][m-1] * sqrt((double)(n-m+1) * ((m == 1) ? 2 : 1) / (n+m));
+      }
+      double gnm = (g[n][m] + dt * gdot[n][m]) * S[n][m];
+      double hnm = (h[n][m] + dt * hdot[n][m]) * S[n][m];
+      double CosMLon = cos(m * Lon);
+      double SinMLon = sin(m * Lon);
+      double Term = gnm * CosMLon + hnm * SinMLon;
+      Br += RatioPow * (n+1) * Term * P[n][m];
+      Btheta -= RatioPow * Term * dP[n][m];
+      Bphi -= RatioPow * m * (-gnm * SinMLon + hnm * CosMLon) * P[n][m];
+    }
+  }
+  Bphi /= SinTheta;
+  // North, east, down in geocentric frame, rotated to geodetic
+  double Xc = -Btheta;
+  double Y = Bphi;
+  double Zc = -Br;
+  double Psi = LatGeocentric - Lat;
+  double X = Xc * cos(Psi) - Zc * sin(Psi);
+  return atan2(Y, X) / DegToRad;
+}
+
+//*****************************************************************************
+double tMagneticModel::GetVariation(double Latitude, double Longitude, uint16_t DaysSince1970) {
+  // Cells end at the poles, where declination is not defined
+  static const int32_t PoleCell = lround(90.0 / GridStep_deg);
+  int32_t LatitudeCell = (int32_t)floor(Latitude / GridStep_deg);
+  if (LatitudeCell >= PoleCell) LatitudeCell = PoleCell - 1;
+  if (LatitudeCell < -PoleCell) LatitudeCell = -PoleCell;
+  int32_t LongitudeCell = (int32_t)floor(remainder(Longitude, 360.0) / GridStep_deg);
+  if (CacheValid && DaysSince1970 == CacheDaysSince1970 &&
+      LatitudeCell == CacheLatitudeCell && LongitudeCell == CacheLongitudeCell) {
+    return CacheVariation;
+  }
+  double DecimalYear = 1970.0 + DaysSince1970 / 365.2425;
+  CacheVariation = CalcDeclination((LatitudeCell + 0.5) * GridStep_deg, (LongitudeCell + 0.5) * GridStep_deg,
+                                   0, DecimalYear) * DegToRad;
+  CacheLatitudeCell = LatitudeCell;
+  CacheLongitudeCell = LongitudeCell;
+  CacheDaysSince1970 = DaysSince1970;
+  CacheValid = true;
+  Evaluations++;
+  return CacheVariation;
+}
@@ -0,0 +1,58 @@
+/*
+MagneticModel.h
+
+Magnetic variation (declination) from the World Magnetic Model.
+
+Coefficients are read from the WMM.COF file distributed by NOAA, so a new
+model epoch only needs a new file, not a rebuild. The spherical harmonic
+evaluation is cached: positions are snapped to the centre of a fixed
+GridStep_deg grid cell, and the model is only evaluated again when the
+vessel enters another cell or the day changes. The variation returned
+thus depends on position and day only, not on where the track started.
+*/
+
+#ifndef MAGNETIC_MODEL_H
+#define MAGNETIC_MODEL_H
+
+#include <stdint.h>
+
+class tMagneticModel {
+public:
+  static const int MaxDegree=12;
+  // Variation changes much less than 0.1 degrees over a cell (about 5.5 km)
+  static const double GridStep_deg;
+
+protected:
+  double Epoch;
+  int Degree;
+  // Schmidt semi-normalized coefficients [n][m] and their yearly change
+  double g[MaxDegree+1][MaxDegree+1];
+  double h[MaxDegree+1][MaxDegree+1];
+  double gdot[MaxDegree+1][MaxDegree+1];
+  double hdot[MaxDegree+1][MaxDegree+1];
+
+  // Cache
+  bool CacheValid;
+  int32_t CacheLatitudeCell;
+  int32_t CacheLongitudeCell;
+  uint16_t CacheDaysSince1970;
+  double CacheVariation;
+  uint64_t Evaluations;
+
+public:
+  tMagneticModel();
+  // Loads WMM.COF format coefficient file. Returns false on failure.
+  bool Load(const char *FileName);
+  bool IsLoaded() const { return Degree > 0; }
+  double GetEpoch() const { return Epoch; }
+  // Evaluates model. Latitude and longitude in degrees, altitude (m) above
+  // WGS84 ellipsoid, time as decimal year. Returns declination in degrees,
+  // positive east.
+  double CalcDeclination(double Latitude, double Longitude, double Altitude, double DecimalYear) const;
+  // Variation in radians at sea level for the grid cell of position and
+  // day. Uses cached value, if still in the same cell and day.
+  double GetVariation(double Latitude, double Longitude, uint16_t DaysSince1970);
+  uint64_t GetEvaluations() const { return Evaluations; }
+};
+
+#endif // MAGNETIC_MODEL_H
@@ -0,0 +1,99 @@
+/*
+Metrics.cpp
+
+Periodic metrics report. See header for details.
+*/
+
+#include "Metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char *MetricsPrefix = "n2kconvert_";
+
+//*****************************************************************************
+tMetricsFile::tMetricsFile(const char *_Path, size_t _MaxReportSize)
+  : Report(new char[_MaxReportSize]), MaxReportSize(_MaxReportSize), ReportLen(0), Truncated(false) {
+  Path[0] = 0;
+  TmpPath[0] = 0;
+  Report[0] = 0;
+  if (_Path != 0 && strlen(_Path) < MaxPathLen) {
+    strcpy(Path, _Path);
+    snprintf(TmpPath, sizeof(TmpPath), "%s.tmp", Path);
+  }
+}
+
+//*****************************************************************************
+tMetricsFile::~tMetricsFile() {
+  delete[] Report;
+}
+
+//*****************************************************************************
+// Line not fitting is cut off at its start, and the report marked truncated
+void tMetricsFile::Append(const char *Fmt, ...) {
+  if (Truncated) return;
+  va_list args;
+  va_start(args, Fmt);
+  int len = vsnprintf(Report + ReportLen, MaxReportSize - ReportLen, Fmt, args);
+  va_end(args);
+  if (len < 0 || (size_t)len >= MaxReportSize - ReportLen) {
+    Report[ReportLen] = 0;
+    Truncated = true;
+    return;
+  }
+  ReportLen += (size_t)len;
+}
+
+//*****************************************************************************
+void tMetricsFile::Begin() {
+  ReportLen = 0;
+  Report[0] = 0;
+  Truncated = false;
+}
+
+//*****************************************************************************
+void tMetricsFile::Add(const char *Name, uint64_t Value) {
+  Append("%s%s %llu\n", MetricsPrefix, Name, (unsigned long long)Value);
+}
+
+//*****************************************************************************
+void tMetricsFile::Add(const char *Name, double Value) {
+  Append("%s%s %g\n", MetricsPrefix, Name, Value);
+}
+
+//*****************************************************************************
+void tMetricsFile::Add(const char *Name, const char *Label, const char *LabelValue, uint64_t Value) {
+  Append("%s%s{%s=\"%s\"} %llu\n", MetricsPrefix, Name, Label, LabelValue, (unsigned long long)Value);
+}
+
+//*****************************************************************************
+void tMetricsFile::Add(const char *Name, const char *Label, const char *LabelValue, double Value) {
+  Append("%s%s{%s=\"%s\"} %g\n", MetricsPrefix, Name, Label, LabelValue, Value);
+}
+
+//*****************************************************************************
+void tMetricsFile::Add(const char *Name, const char *Label1, const char *LabelValue1,
+                       const char *Label2, const char *LabelValue2, uint64_t Value) {
+  Append("%s%s{%s=\"%s\",%s=\"%s\"} %llu\n", MetricsPrefix, Name, Label1, LabelValue1,
+         Label2, LabelValue2, (unsigned long long)Value);
+}
+
+//*****************************************************************************
+void tMetricsFile::Add(const char *Name, const char *Label1, const char *LabelValue1,
+                       const char *Label2, const char *LabelValue2, double Value) {
+  Append("%s%s{%s=\"%s\",%s=\"%s\"} %g\n", MetricsPrefix, Name, Label1, LabelValue1,
+         Label2, LabelValue2, Value);
+}
+
+//*****************************************************************************
+bool tMetricsFile::Commit() {
+  if (!IsEnabled() || Truncated) return false;
+  int fd = open(TmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return false;
+  bool ok = (write(fd, Report, ReportLen) == (ssize_t)ReportLen);
+  close(fd);
+  if (ok) ok = (rename(TmpPath, Path) == 0);
+  return ok;
+}
@@ -0,0 +1,57 @@
+/*
+Metrics.h
+
+Periodic metrics report. Values are collected into a fixed buffer and
+written as a plain "name value" text file (Prometheus text format), replaced
+atomically, so node_exporter's textfile collector or a simple cat can read
+it. No heap allocation happens after construction. A report not fitting
+the buffer is not written, so a file never ends mid-line or misses values
+silently.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class tMetricsFile {
+public:
+  static const size_t DefaultReportSize=16384;
+  // Upper bound of one value line with the names and labels we use
+  static const size_t MaxLineLen=128;
+
+protected:
+  static const size_t MaxPathLen=256;
+  char Path[MaxPathLen];
+  char TmpPath[MaxPathLen+4];
+  char *Report;
+  size_t MaxReportSize;
+  size_t ReportLen;
+  bool Truncated;
+
+  void Append(const char *Fmt, ...);
+
+public:
+  tMetricsFile(const char *_Path, size_t _MaxReportSize=DefaultReportSize);
+  ~tMetricsFile();
+  bool IsEnabled() const { return Path[0] != 0; }
+  // Starts a new report
+  void Begin();
+  void Add(const char *Name, uint64_t Value);
+  void Add(const char *Name, double Value);
+  // Adds value with a single label, e.g. Add("sentences", "sink", "out", 5)
+  void Add(const char *Name, const char *Label, const char *LabelValue, uint64_t Value);
+  void Add(const char *Name, const char *Label, const char *LabelValue, double Value);
+  // Adds value with two labels
+  void Add(const char *Name, const char *Label1, const char *LabelValue1,
+           const char *Label2, const char *LabelValue2, uint64_t Value);
+  void Add(const char *Name, const char *Label1, const char *LabelValue1,
+           const char *Label2, const char *LabelValue2, double Value);
+  // Writes the report to file. Returns false on failure, or if the report
+  // did not fit the buffer.
+  bool Commit();
+  const char* GetReport() const { return Report; }
+};
+
+#endif // METRICS_H
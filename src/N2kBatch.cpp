@@ -0,0 +1,325 @@
+/*
+n2kbatch
+Offline conversion of candump captures to NMEA0183, using all cores.
+
+The capture is split into time shards, which are converted in parallel,
+each by its own tN2kDataToNMEA0183 instance. Converter state (headings,
+variation, position, ...) builds up from earlier data, so every shard
+starts converting a pre-roll window before its own start and only writes
+output from its own time range. Shards are disjoint in time, so
+concatenating their output in shard order gives the result in time order.
+
+Conversion runs on virtual time: frames are released and Update() is
+called on a fixed 50 ms tick grid derived from capture time stamps, like
+n2kconvert does in real time. With the same grid, a shard produces the
+same sentences as a single threaded run over the whole capture, as long
+as the pre-roll is longer than the converter input timeouts.
+
+Captures without time stamps cannot be split and are converted as one
+shard.
+*/
+
+#include <boost/program_options.hpp>
+#include <NMEA0183.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include "N2kDataToNMEA0183.h"
+#include "MagneticModel.h"
+#include "ColumnWriter.h"
+#include "NMEA2000_CandumpReplay.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+// Same period as the n2kconvert main loop
+static const uint64_t Tick_us = 50000;
+
+static const unsigned char N2kCANMsgBufSize = 32;
+static const uint16_t N2kCANReceiveFrameBufSize = 256;
+
+//------------------------------------------------------------------------------
+// Buffered file output. Output can be switched off during pre-roll.
+class tNMEA0183FileStream : public tNMEA0183Stream {
+protected:
+  FILE *File;
+  bool Enabled;
+public:
+  uint64_t Sentences;
+
+  tNMEA0183FileStream() : File(0), Enabled(false), Sentences(0) {}
+  ~tNMEA0183FileStream() { Close(); }
+  bool Open(const char *Path) {
+    File = fopen(Path, "w");
+    if (File) setvbuf(File, 0, _IOFBF, 256*1024);
+    return File != 0;
+  }
+  bool Close() {
+    bool ok = true;
+    if (File) ok = (fclose(File) == 0);
+    File = 0;
+    return ok;
+  }
+  void Enable(bool _Enabled) { Enabled = _Enabled; }
+
+  // tNMEA0183Stream
+  int read() { return -1; }
+  size_t write(const uint8_t* data, size_t size) {
+    if (!Enabled || File == 0) return size;
+    for (size_t i = 0; i < size; i++) {
+      if (data[i] == '\n') Sentences++;
+    }
+    return fwrite(data, 1, size, File);
+  }
+};
+
+//------------------------------------------------------------------------------
+struct tShard {
+  // Output time range (Start_us, End_us] on tick grid, conversion starts
+  // pre-roll earlier. Last shard runs to end of capture.
+  uint64_t Start_us;
+  uint64_t End_us;
+  bool Last;
+  string PartFile;
+  string ColumnPartFile;
+  bool ok;
+  uint64_t Frames;
+  uint64_t Sentences;
+  uint64_t BadLines;
+};
+
+//------------------------------------------------------------------------------
+struct tBatchJob {
+  string InputFile;
+  string WMMFile;
+  string ColumnsFile;
+  unsigned long ColumnsPeriod_ms;
+  double DepthOffset_ft;
+  uint64_t Origin_us;
+  uint64_t Preroll_us;
+  bool Timed;
+  vector<tShard> Shards;
+  atomic<size_t> NextShard;
+  tBatchJob() : ColumnsPeriod_ms(1000), DepthOffset_ft(0), Origin_us(0), Preroll_us(0), Timed(false), NextShard(0) {}
+};
+
+//*****************************************************************************
+static bool ConvertShard(tBatchJob &Job, tShard &Shard) {
+  tNMEA2000_CandumpReplay Replay(Job.InputFile.c_str());
+  uint64_t From_us = Job.Origin_us;
+  if (Shard.Start_us > Job.Origin_us + Job.Preroll_us) From_us = Shard.Start_us - Job.Preroll_us;
+  if (Job.Timed) {
+    long StartOffset = Replay.FindTimeOffset(From_us);
+    long EndOffset = Shard.Last ? -1 : Replay.FindTimeOffset(Shard.End_us);
+    if (StartOffset < 0 || (!Shard.Last && EndOffset < 0)) {
+      cerr << "Cannot read " << Job.InputFile << "\n";
+      return false;
+    }
+    Replay.SetRange(StartOffset, EndOffset);
+  }
+  tNMEA0183FileStream Out;
+  if (!Out.Open(Shard.PartFile.c_str())) {
+    cerr << "Cannot create " << Shard.PartFile << "\n";
+    return false;
+  }
+  tNMEA0183 NMEA0183Out(&Out);
+  tMagneticModel MagneticModel;
+  tN2kDataToNMEA0183 N2kDataToNMEA0183(&Replay, NULL, &NMEA0183Out);
+  if (!Job.WMMFile.empty()) {
+    if (!MagneticModel.Load(Job.WMMFile.c_str())) return false;
+    N2kDataToNMEA0183.SetMagneticModel(&MagneticModel);
+  }
+  N2kDataToNMEA0183.SetDepthOffset(Job.DepthOffset_ft);
+  tColumnWriter Columns;
+  if (!Job.ColumnsFile.empty() &&
+      !Columns.Open(Shard.ColumnPartFile.c_str(), tN2kDataToNMEA0183::ColumnNames, tN2kDataToNMEA0183::col_Count)) {
+    return false;
+  }
+  // Listen only, there is nobody to claim an address from
+  Replay.SetMode(tNMEA2000::N2km_ListenOnly);
+  Replay.SetN2kCANMsgBufSize(N2kCANMsgBufSize);
+  Replay.SetN2kCANReceiveFrameBufSize(N2kCANReceiveFrameBufSize);
+  Replay.AttachMsgHandler(&N2kDataToNMEA0183);
+  if (!Replay.Open() || !NMEA0183Out.Open()) return false;
+
+  for (uint64_t Time_us = From_us + Tick_us; Shard.Last ? !Replay.AtEnd() : Time_us <= Shard.End_us; Time_us += Tick_us) {
+    // Same as one pass of n2kconvert main loop at Time_us
+    N2kDataToNMEA0183.SetTime((Time_us - Job.Origin_us) / 1000);
+    Out.Enable(Time_us > Shard.Start_us);
+    if (Columns.IsOpen()) {
+      N2kDataToNMEA0183.SetColumnOutput(Time_us > Shard.Start_us ? &Columns : NULL, Job.ColumnsPeriod_ms);
+    }
+    Replay.ReleaseUntil(Time_us - 1);
+    while (Replay.HasReleasedFrame()) {
+      Replay.ParseMessages();
+    }
+    N2kDataToNMEA0183.Update();
+  }
+  Shard.Frames = Replay.GetFramesRead();
+  Shard.BadLines = Replay.GetBadLines();
+  Shard.Sentences = Out.Sentences;
+  Columns.Close();
+  if (!Out.Close()) {
+    cerr << "Cannot write " << Shard.PartFile << "\n";
+    return false;
+  }
+  return true;
+}
+
+//*****************************************************************************
+static void Worker(tBatchJob *pJob) {
+  for (size_t i = pJob->NextShard++; i < pJob->Shards.size(); i = pJob->NextShard++) {
+    pJob->Shards[i].ok = ConvertShard(*pJob, pJob->Shards[i]);
+  }
+}
+
+//*****************************************************************************
+// Splits capture into shards of whole seconds. Untimed captures are one shard.
+static void PlanShards(tBatchJob &Job, tNMEA2000_CandumpReplay &Probe, int nShards, const string &OutputFile) {
+  uint64_t First_us, Last_us;
+  Job.Timed = Probe.GetTimeSpan(First_us, Last_us);
+  uint64_t Seconds = 1;
+  if (Job.Timed) {
+    Job.Origin_us = First_us / 1000000 * 1000000;
+    Seconds = (Last_us - Job.Origin_us) / 1000000 + 1;
+  } else {
+    nShards = 1;
+  }
+  if (nShards < 1) nShards = 1;
+  uint64_t ShardSeconds = (Seconds + nShards - 1) / nShards;
+  for (uint64_t Start = 0; Start < Seconds; Start += ShardSeconds) {
+    tShard Shard;
+    Shard.Start_us = Job.Origin_us + Start * 1000000;
+    Shard.End_us = Shard.Start_us + ShardSeconds * 1000000;
+    Shard.Last = (Start + ShardSeconds >= Seconds);
+    Shard.PartFile = OutputFile + ".part" + to_string(Job.Shards.size());
+    Shard.ColumnPartFile = Job.ColumnsFile + ".part" + to_string(Job.Shards.size());
+    Shard.ok = false;
+    Shard.Frames = Shard.Sentences = Shard.BadLines = 0;
+    Job.Shards.push_back(Shard);
+  }
+}
+
+//*****************************************************************************
+// Appends part files to output in shard order and removes them
+static bool MergeParts(const tBatchJob &Job, const string &OutputFile) {
+  FILE *Output = fopen(OutputFile.c_str(), "w");
+  if (Output == 0) {
+    cerr << "Cannot create " << OutputFile << "\n";
+    return false;
+  }
+  vector<char> Buf(256*1024);
+  bool ok = true;
+  for (const tShard &Shard : Job.Shards) {
+    FILE *Part = fopen(Shard.PartFile.c_str(), "r");
+    if (Part == 0) { ok = false; break; }
+    size_t Len;
+    while ((Len = fread(Buf.data(), 1, Buf.size(), Part)) > 0) {
+      if (fwrite(Buf.data(), 1, Len, Output) != Len) { ok = false; break; }
+    }
+    fclose(Part);
+    remove(Shard.PartFile.c_str());
+  }
+  if (fclose(Output) != 0) ok = false;
+  if (!ok) cerr << "Cannot write " << OutputFile << "\n";
+  return ok;
+}
+
+//*****************************************************************************
+// Time series parts are merged by appending their blocks to the first part
+static bool MergeColumnParts(const tBatchJob &Job) {
+  FILE *Output = fopen(Job.ColumnsFile.c_str(), "w");
+  if (Output == 0) {
+    cerr << "Cannot create " << Job.ColumnsFile << "\n";
+    return false;
+  }
+  vector<char> Buf(256*1024);
+  bool ok = true;
+  for (size_t i = 0; i < Job.Shards.size(); i++) {
+    const tShard &Shard = Job.Shards[i];
+    FILE *Part = fopen(Shard.ColumnPartFile.c_str(), "r");
+    if (Part == 0) { ok = false; break; }
+    if (i > 0 && fseek(Part, tColumnWriter::HeaderSize, SEEK_SET) != 0) ok = false;
+    size_t Len;
+    while (ok && (Len = fread(Buf.data(), 1, Buf.size(), Part)) > 0) {
+      if (fwrite(Buf.data(), 1, Len, Output) != Len) ok = false;
+    }
+    fclose(Part);
+    remove(Shard.ColumnPartFile.c_str());
+  }
+  if (fclose(Output) != 0) ok = false;
+  if (!ok) cerr << "Cannot write " << Job.ColumnsFile << "\n";
+  return ok;
+}
+
+//*****************************************************************************
+int main(int argc, char* argv[]) {
+  string input_file, output_file;
+  int jobs, shards;
+  double preroll, columns_period;
+  tBatchJob Job;
+  po::options_description options("n2kbatch options");
+  options.add_options()
+    ("help", "produce help message")
+    ("input,i", po::value<string>(&input_file), "candump capture to convert")
+    ("output,o", po::value<string>(&output_file), "NMEA0183 output file")
+    ("jobs,j", po::value<int>(&jobs)->default_value(thread::hardware_concurrency()), "parallel conversion threads")
+    ("shards,s", po::value<int>(&shards)->default_value(0), "number of time shards, 0 for 4 per job")
+    ("preroll,p", po::value<double>(&preroll)->default_value(10), "state pre-roll before each shard (s)")
+    ("depth,d", po::value<double>(&Job.DepthOffset_ft)->default_value(0.0), "depth offset (ft) to apply to transducer (DPT message)")
+    ("wmm", po::value<string>(&Job.WMMFile), "World Magnetic Model coefficient file (WMM.COF)")
+    ("columns,c", po::value<string>(&Job.ColumnsFile), "also write decoded values to columnar time series file")
+    ("columnsperiod", po::value<double>(&columns_period)->default_value(1), "time series row period (s)")
+  ;
+  po::positional_options_description positional;
+  positional.add("input", 1).add("output", 1);
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(options).positional(positional).run(), vm);
+  po::notify(vm);
+  if (vm.count("help") || input_file.empty() || output_file.empty()) {
+    cout << "Usage: n2kbatch [options] <capture> <output>\n" << options << "\n";
+    return vm.count("help") ? 0 : 3;
+  }
+  if (jobs < 1) jobs = 1;
+  if (shards < 1) shards = jobs * 4;
+  Job.InputFile = input_file;
+  if (columns_period > 0) Job.ColumnsPeriod_ms = (unsigned long)(columns_period * 1000);
+  Job.Preroll_us = (preroll > 0) ? (uint64_t)(preroll * 1e6) / Tick_us * Tick_us : 0;
+  tNMEA2000_CandumpReplay Probe(input_file.c_str());
+  PlanShards(Job, Probe, shards, output_file);
+  if (!Job.Timed) {
+    cout << "Capture has no time stamps, converting as one shard.\n";
+  }
+
+  auto start = chrono::steady_clock::now();
+  vector<thread> Workers;
+  size_t nWorkers = min((size_t)jobs, Job.Shards.size());
+  for (size_t i = 0; i < nWorkers; i++) {
+    Workers.push_back(thread(Worker, &Job));
+  }
+  for (thread &Worker : Workers) {
+    Worker.join();
+  }
+  uint64_t Frames = 0, Sentences = 0, BadLines = 0;
+  bool ok = true;
+  for (const tShard &Shard : Job.Shards) {
+    ok = ok && Shard.ok;
+    Frames += Shard.Frames;
+    Sentences += Shard.Sentences;
+    BadLines += Shard.BadLines;
+  }
+  ok = MergeParts(Job, output_file) && ok;
+  if (!Job.ColumnsFile.empty()) {
+    ok = MergeColumnParts(Job) && ok;
+  }
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  // Frames in pre-roll windows are read twice, so Frames is more than capture has
+  cout << "Summary: " << Job.Shards.size() << " shards on " << nWorkers << " threads, "
+       << Frames << " frames read, " << Sentences << " sentences, "
+       << BadLines << " bad lines in " << elapsed << "s\n";
+  return ok ? 0 : 1;
+}
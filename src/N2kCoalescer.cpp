@@ -0,0 +1,93 @@
+/*
+N2kCoalescer.cpp
+
+Latest-wins coalescing of high rate NMEA2000 messages. See header for details.
+*/
+
+#include "N2kCoalescer.h"
+#include <stdlib.h>
+
+//*****************************************************************************
+tN2kCoalescer::tN2kCoalescer() : PGNCount(0), SlotCount(0), SlotOverflows(0) {
+  for (size_t i = 0; i < MaxPGNs; i++) {
+    PGNs[i] = 0;
+    Coalesced[i] = 0;
+  }
+}
+
+//*****************************************************************************
+bool tN2kCoalescer::SetPGNs(const char *List) {
+  PGNCount = 0;
+  SlotCount = 0;
+  const char *p = List;
+  while (p != 0 && *p != 0) {
+    while (*p == ' ' || *p == ',') p++;
+    if (*p == 0) break;
+    char *End;
+    unsigned long PGN = strtoul(p, &End, 10);
+    if (End == p || PGN == 0 || PGNCount >= MaxPGNs) {
+      PGNCount = 0;
+      return false;
+    }
+    if (FindPGN(PGN) < 0) {
+      PGNs[PGNCount] = PGN;
+      Coalesced[PGNCount] = 0;
+      PGNCount++;
+    }
+    p = End;
+  }
+  return true;
+}
+
+//*****************************************************************************
+int tN2kCoalescer::FindPGN(unsigned long PGN) const {
+  for (size_t i = 0; i < PGNCount; i++) {
+    if (PGNs[i] == PGN) return i;
+  }
+  return -1;
+}
+
+//*****************************************************************************
+// Part of the key telling apart messages of same PGN and source, which
+// carry different data, e.g. magnetic and true heading from one compass.
+uint8_t tN2kCoalescer::GetInstance(const tN2kMsg &N2kMsg) {
+  const unsigned char *Data = N2kMsg.Data;
+  switch (N2kMsg.PGN) {
+    case 127250UL: return (N2kMsg.DataLen > 7) ? (Data[7] & 0x03) : 0; // Heading reference
+    case 129026UL: return (N2kMsg.DataLen > 1) ? (Data[1] & 0x03) : 0; // COG reference
+    case 130306UL: return (N2kMsg.DataLen > 5) ? (Data[5] & 0x07) : 0; // Wind reference
+    case 130311UL: return (N2kMsg.DataLen > 1) ? (Data[1] & 0x3f) : 0; // Temperature source
+    case 127245UL: // Rudder
+    case 127488UL: // Engine parameters, rapid
+    case 127489UL: // Engine parameters, dynamic
+    case 127505UL: // Fluid level
+    case 127508UL: // Battery status
+      return (N2kMsg.DataLen > 0) ? Data[0] : 0;
+    default: return 0;
+  }
+}
+
+//*****************************************************************************
+bool tN2kCoalescer::Add(const tN2kMsg &N2kMsg) {
+  int PGNIndex = FindPGN(N2kMsg.PGN);
+  if (PGNIndex < 0) return false;
+  uint8_t Instance = GetInstance(N2kMsg);
+  for (size_t i = 0; i < SlotCount; i++) {
+    tSlot &Slot = Slots[i];
+    if (Slot.PGN == N2kMsg.PGN && Slot.Source == N2kMsg.Source && Slot.Instance == Instance) {
+      Slot.Msg = N2kMsg;
+      Coalesced[PGNIndex]++;
+      return true;
+    }
+  }
+  if (SlotCount >= MaxSlots) {
+    SlotOverflows++;
+    return false;
+  }
+  tSlot &Slot = Slots[SlotCount++];
+  Slot.PGN = N2kMsg.PGN;
+  Slot.Source = N2kMsg.Source;
+  Slot.Instance = Instance;
+  Slot.Msg = N2kMsg;
+  return true;
+}
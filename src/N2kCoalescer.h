@@ -0,0 +1,65 @@
+/*
+N2kCoalescer.h
+
+Latest-wins coalescing of high rate NMEA2000 messages. Messages of
+configured PGNs are not handled as they arrive, but kept in a slot keyed
+by (PGN, source, instance). A newer message with the same key replaces
+the older one, which is counted as coalesced. Pending messages are handled
+once per processing cycle, so conversion and output follow the distinct
+data instead of the raw bus rate.
+
+Slots are fixed, no heap allocation happens after construction.
+*/
+
+#ifndef N2K_COALESCER_H
+#define N2K_COALESCER_H
+
+#include <N2kMsg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class tN2kCoalescer {
+public:
+  static const size_t MaxPGNs=16;
+  static const size_t MaxSlots=32;
+
+protected:
+  struct tSlot {
+    unsigned long PGN;
+    uint8_t Source;
+    uint8_t Instance;
+    tN2kMsg Msg;
+  };
+
+  unsigned long PGNs[MaxPGNs];
+  uint64_t Coalesced[MaxPGNs];
+  size_t PGNCount;
+  tSlot Slots[MaxSlots];
+  size_t SlotCount;
+  uint64_t SlotOverflows;
+
+  int FindPGN(unsigned long PGN) const;
+  static uint8_t GetInstance(const tN2kMsg &N2kMsg);
+
+public:
+  tN2kCoalescer();
+  // Sets coalesced PGNs from comma separated list, e.g. "127250,130306".
+  // Returns false on parse error or too many PGNs.
+  bool SetPGNs(const char *List);
+  bool IsEnabled() const { return PGNCount > 0; }
+  // Takes message for coalescing. Returns false, if message should be
+  // handled right away (PGN not coalesced or no free slot).
+  bool Add(const tN2kMsg &N2kMsg);
+  // Messages pending for this cycle, in order of first arrival
+  size_t GetPendingCount() const { return SlotCount; }
+  const tN2kMsg& GetPending(size_t Index) const { return Slots[Index].Msg; }
+  // Ends cycle, call after pending messages have been handled
+  void Clear() { SlotCount = 0; }
+
+  size_t GetPGNCount() const { return PGNCount; }
+  unsigned long GetPGN(size_t Index) const { return PGNs[Index]; }
+  uint64_t GetCoalescedCount(size_t Index) const { return Coalesced[Index]; }
+  uint64_t GetSlotOverflows() const { return SlotOverflows; }
+};
+
+#endif // N2K_COALESCER_H
@@ -41,18 +41,41 @@ SOFTWARE.
 #include <NMEA2000_SocketCAN.h>
 #include <NMEA0183LinuxStream.h>
 #include "N2kDataToNMEA0183.h"
+#include "NMEA0183AsyncSink.h"
+#include "Metrics.h"
+#include "LatencyHistogram.h"
+#include "Realtime.h"
+#include "HeapGuard.h"
+#include "NMEA2000_CandumpReplay.h"
+#include "NMEA2000_CANSocket.h"
+#include "BusAnalyzer.h"
+#include "NMEA2000_CANUDP.h"
+#include "CANUDPBridge.h"
+#include "NTPShm.h"
+#include "SignalKWriter.h"
+#include "N2kCoalescer.h"
+#include "MagneticModel.h"
+#include "ColumnWriter.h"
+#include "LoopMonitor.h"
+#include "SystemdNotify.h"
 #include "BoardSerialNumber.h"
 #include "Options.h"
 #include <iostream>
 #include <csignal>
 #include <chrono>
 #include <thread>
+#include <math.h>
 
 // Reading serial number depends of used board. BoardSerialNumber module
 // has methods for RPi, Arduino DUE and Teensy. For others function returns
 // 0 and then DefaultSerialNumber will be used.
 static const uint32_t DefaultSerialNumber = 999999;
 
+// NMEA2000 library buffers are allocated once in Open(). Size them for
+// fast packet bursts (AIS, GNSS), the main loop must not allocate later.
+static const unsigned char N2kCANMsgBufSize = 32;
+static const uint16_t N2kCANReceiveFrameBufSize = 256;
+
 // Set the information for other bus devices, which messages we support
 static const unsigned long TransmitMessages[] = {0};
 static const unsigned long ReceiveMessages[] = {
@@ -64,12 +87,28 @@ static const unsigned long ReceiveMessages[] = {
   129026, // COG SOG rapid
   129029, // GNSS Data
   130306, // Wind
+  129038, // AIS Class A position report
+  129039, // AIS Class B position report
+  129794, // AIS Class A static and voyage data
+  129809, // AIS Class B static data, part A
+  129810, // AIS Class B static data, part B
+  126992, // System Time
   0
 };
 
+// Main loop period
+static const auto LoopPeriod = std::chrono::milliseconds(50);
+
+// Output formats, selectable per output
+enum tOutputFormat { of_NMEA0183, of_SignalK };
+
 // Flag for stopping program
 static bool run_program = true;
 
+// GNSS time goes to NTP SHM with receive time of the CAN frame
+static tNTPShm *pNTPShm = NULL;
+static const tNMEA2000_CANSocket *pTimeSource = NULL;
+
 // For cout and cerr
 using namespace std;
 
@@ -78,7 +117,8 @@ using namespace std;
 // and data conversion.
 bool Setup( tNMEA2000& NMEA2000,
             tNMEA0183* pNMEA0183AuxIn,
-            tNMEA0183& NMEA0183Out,
+            tNMEA0183AsyncSink& OutSink,
+            tNMEA0183AsyncSink* pOut2Sink,
             tN2kDataToNMEA0183& N2kDataToNMEA0183,
             tSocketStream* pForwardStream) {
   bool status = false;
@@ -109,6 +149,9 @@ bool Setup( tNMEA2000& NMEA2000,
   }
   // Mode
   NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode,25);
+  // Buffers
+  NMEA2000.SetN2kCANMsgBufSize(N2kCANMsgBufSize);
+  NMEA2000.SetN2kCANReceiveFrameBufSize(N2kCANReceiveFrameBufSize);
   // Message settings
   NMEA2000.ExtendTransmitMessages(TransmitMessages);
   NMEA2000.ExtendReceiveMessages(ReceiveMessages);
@@ -128,22 +171,258 @@ bool Setup( tNMEA2000& NMEA2000,
       return false;
     }
   }
-  // Open NMEA013 output
-  status = NMEA0183Out.Open();
+  // Open outputs. The sinks connect to the output in the background,
+  // so a missing reader is not an error here.
+  status = OutSink.Open() && (pOut2Sink == NULL || pOut2Sink->Open());
   if (!status) {
-    cerr << "Problem opening NMEA0183Out port.\n";
+    cerr << "Problem opening output port.\n";
     return false;
   }
   // Setup was successful
   return true;
 }
 
+// ******** ParseOutputFormat ********
+bool ParseOutputFormat(const string& Name, tOutputFormat& Format) {
+  if (Name == "nmea0183") {
+    Format = of_NMEA0183;
+  } else if (Name == "signalk") {
+    Format = of_SignalK;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 // ******** WaitForEvent ********
 // This is preliminary definition. Polls periodically.
+// Returns how late (us) we woke up compared to schedule.
 auto sched_time = chrono::steady_clock::now();
-void WaitForEvent() {
-  sched_time += chrono::milliseconds(50);
+uint32_t WaitForEvent() {
+  sched_time += LoopPeriod;
   this_thread::sleep_until(sched_time);
+  auto late = chrono::steady_clock::now() - sched_time;
+  // Slots we missed completely are skipped instead of run back to back.
+  // Every pass handles all pending input anyway.
+  if (late >= LoopPeriod) {
+    sched_time += (late / LoopPeriod) * LoopPeriod;
+  }
+  auto late_us = chrono::duration_cast<chrono::microseconds>(late).count();
+  return (late_us > 0) ? late_us : 0;
+}
+
+// ******** HandleGNSSTime ********
+// Called by converter, while the frame completing the time message is
+// still the last one received.
+void HandleGNSSTime(uint16_t DaysSince1970, double SecondsSinceMidnight) {
+  if (pNTPShm == NULL || pTimeSource == NULL) return;
+  double Seconds = floor(SecondsSinceMidnight);
+  struct timespec Reference;
+  Reference.tv_sec = (time_t)DaysSince1970 * 86400 + (time_t)Seconds;
+  Reference.tv_nsec = (long)((SecondsSinceMidnight - Seconds) * 1e9);
+  pNTPShm->Update(pTimeSource->GetLastFrameTime(), Reference);
+}
+
+// ******** ReportOutputMetrics ********
+// Adds statistics of one output sink, labeled with its name
+void ReportOutputMetrics(tMetricsFile& Metrics, const tNMEA0183AsyncSink& OutSink, const char* SinkName) {
+  tNMEA0183AsyncSink::tStats OutStats;
+  OutSink.GetStats(OutStats);
+  Metrics.Add("output_bytes_written_total", "sink", SinkName, OutStats.BytesWritten);
+  Metrics.Add("output_sentences_written_total", "sink", SinkName, OutStats.SentencesWritten);
+  Metrics.Add("output_sentences_dropped_total", "sink", SinkName, OutStats.SentencesDropped);
+  Metrics.Add("output_blocked_seconds_total", "sink", SinkName, OutStats.BlockedTime_us / 1e6);
+  Metrics.Add("output_reconnects_total", "sink", SinkName, (uint64_t)OutStats.Reconnects);
+  Metrics.Add("output_connected", "sink", SinkName, (uint64_t)OutStats.Connected);
+}
+
+// ******** ReportDampingMetrics ********
+// Adds statistics of damping windows, labeled with the value name
+void ReportDampingMetrics(tMetricsFile& Metrics, const tRollingScalar& Window, const char* ValueName) {
+  if (Window.GetCount() == 0) return;
+  Metrics.Add("damped_mean", "value", ValueName, Window.GetMean());
+  Metrics.Add("damped_min", "value", ValueName, Window.GetMin());
+  Metrics.Add("damped_max", "value", ValueName, Window.GetMax());
+}
+
+void ReportDampingMetrics(tMetricsFile& Metrics, const tRollingAngle& Window, const char* ValueName) {
+  if (Window.GetCount() == 0) return;
+  Metrics.Add("damped_mean_degrees", "value", ValueName, Window.GetMean() * 180.0 / M_PI);
+  Metrics.Add("damped_stddev_degrees", "value", ValueName, Window.GetStdDev() * 180.0 / M_PI);
+}
+
+// ******** ReportBusAnalysis ********
+// Writes bus analysis of the last period to its own metrics file
+void ReportBusAnalysis(tMetricsFile& Metrics, tBusAnalyzer& Analyzer,
+                       const tNMEA2000_CANSocket& CANSocket, double Period_s) {
+  Metrics.Begin();
+  Analyzer.Report(Metrics, Period_s);
+  // Frames dropped by kernel were never seen by the analyzer
+  tNMEA2000_CANSocket::tStats CANStats;
+  CANSocket.GetStats(CANStats);
+  Metrics.Add("can_kernel_drops_total", CANStats.KernelDrops);
+  if (!Metrics.Commit()) {
+    cerr << "Problem writing bus analysis file.\n";
+  }
+}
+
+// ******** ReportMetrics ********
+// Writes periodic statistics to the metrics file
+void ReportMetrics(tMetricsFile& Metrics,
+                   const tNMEA2000_CANSocket* pCANSocket,
+                   const tNMEA2000_CANUDP* pCANUDP,
+                   const tNMEA0183AsyncSink& OutSink,
+                   const tNMEA0183AsyncSink* pOut2Sink,
+                   const tSignalKWriter* pSignalKOut,
+                   tSentencePool& SentencePool,
+                   const tLoopMonitor& LoopMonitor,
+                   const tLatencyHistogram* pWakeJitter,
+                   const tNTPShm* pNTPShm,
+                   const tN2kCoalescer& Coalescer,
+                   const tMagneticModel& MagneticModel,
+                   const tColumnWriter& ColumnOut,
+                   const tN2kDataToNMEA0183& N2kDataToNMEA0183) {
+  Metrics.Begin();
+  if (pCANSocket) {
+    tNMEA2000_CANSocket::tStats CANStats;
+    pCANSocket->GetStats(CANStats);
+    Metrics.Add("can_frames_received_total", CANStats.FramesReceived);
+    Metrics.Add("can_kernel_drops_total", CANStats.KernelDrops);
+    Metrics.Add("can_frames_sent_total", CANStats.FramesSent);
+    Metrics.Add("can_send_errors_total", CANStats.SendErrors);
+  }
+  if (pCANUDP) {
+    tNMEA2000_CANUDP::tStats UDPStats;
+    pCANUDP->GetStats(UDPStats);
+    Metrics.Add("can_frames_received_total", UDPStats.FramesReceived);
+    Metrics.Add("udp_frames_lost_total", UDPStats.FramesLost);
+    Metrics.Add("udp_datagrams_received_total", UDPStats.DatagramsReceived);
+    Metrics.Add("udp_datagrams_reordered_total", UDPStats.DatagramsReordered);
+    Metrics.Add("udp_datagrams_late_total", UDPStats.DatagramsLate);
+    Metrics.Add("udp_datagrams_bad_total", UDPStats.BadDatagrams);
+    Metrics.Add("udp_bridge_restarts_total", (uint64_t)UDPStats.SenderRestarts);
+    Metrics.Add("udp_bridge_kernel_drops_total", (uint64_t)UDPStats.BridgeKernelDrops);
+  }
+  ReportOutputMetrics(Metrics, OutSink, "output");
+  if (pOut2Sink) {
+    ReportOutputMetrics(Metrics, *pOut2Sink, "output2");
+  }
+  tSentencePool::tStats PoolStats;
+  SentencePool.GetStats(PoolStats);
+  Metrics.Add("sentences_formatted_total", PoolStats.Formatted);
+  Metrics.Add("sentence_buffers_in_use", (uint64_t)PoolStats.InUse);
+  Metrics.Add("sentence_buffers_exhausted_total", PoolStats.Exhausted);
+  if (pSignalKOut) {
+    tSignalKWriter::tStats SignalKStats;
+    pSignalKOut->GetStats(SignalKStats);
+    Metrics.Add("signalk_deltas_total", SignalKStats.DeltasWritten);
+    Metrics.Add("signalk_values_total", SignalKStats.ValuesWritten);
+  }
+  Metrics.Add("heap_allocations_total", HeapGuardTotalAllocations());
+  Metrics.Add("heap_allocations_steady_total", HeapGuardSteadyAllocations());
+  tLoopMonitor::tStats LoopStats;
+  LoopMonitor.GetStats(LoopStats);
+  const tLatencyHistogram& LoopBusy = LoopMonitor.GetBusyHistogram();
+  Metrics.Add("loop_iterations_total", LoopStats.Iterations);
+  Metrics.Add("loop_overruns_total", LoopStats.Overruns);
+  Metrics.Add("loop_missed_slots_total", LoopStats.MissedSlots);
+  Metrics.Add("loop_busy_us", "quantile", "0.5", (uint64_t)LoopBusy.GetPercentile(50));
+  Metrics.Add("loop_busy_us", "quantile", "0.99", (uint64_t)LoopBusy.GetPercentile(99));
+  Metrics.Add("loop_busy_us", "quantile", "1", (uint64_t)LoopBusy.GetMax());
+  if (pWakeJitter) {
+    Metrics.Add("wakeup_late_us", "quantile", "0.5", (uint64_t)pWakeJitter->GetPercentile(50));
+    Metrics.Add("wakeup_late_us", "quantile", "0.99", (uint64_t)pWakeJitter->GetPercentile(99));
+    Metrics.Add("wakeup_late_us", "quantile", "0.999", (uint64_t)pWakeJitter->GetPercentile(99.9));
+    Metrics.Add("wakeup_late_us", "quantile", "1", (uint64_t)pWakeJitter->GetMax());
+  }
+  if (Coalescer.IsEnabled()) {
+    char pgn[12];
+    for (size_t i = 0; i < Coalescer.GetPGNCount(); i++) {
+      snprintf(pgn, sizeof(pgn), "%lu", Coalescer.GetPGN(i));
+      Metrics.Add("coalesced_total", "pgn", pgn, Coalescer.GetCoalescedCount(i));
+    }
+    Metrics.Add("coalesce_slot_overflows_total", Coalescer.GetSlotOverflows());
+  }
+  if (MagneticModel.IsLoaded()) {
+    Metrics.Add("wmm_evaluations_total", MagneticModel.GetEvaluations());
+  }
+  if (ColumnOut.IsOpen()) {
+    tColumnWriter::tStats ColumnStats;
+    ColumnOut.GetStats(ColumnStats);
+    Metrics.Add("columns_rows_total", ColumnStats.Rows);
+    Metrics.Add("columns_write_errors_total", ColumnStats.WriteErrors);
+  }
+  ReportDampingMetrics(Metrics, N2kDataToNMEA0183.GetDampedWindAngleApp(), "wind_angle_apparent");
+  ReportDampingMetrics(Metrics, N2kDataToNMEA0183.GetDampedWindSpeedApp(), "wind_speed_apparent");
+  ReportDampingMetrics(Metrics, N2kDataToNMEA0183.GetDampedWindDirTrue(), "wind_direction_true");
+  ReportDampingMetrics(Metrics, N2kDataToNMEA0183.GetDampedWindSpeedTrue(), "wind_speed_true");
+  ReportDampingMetrics(Metrics, N2kDataToNMEA0183.GetDampedHeadingTrue(), "heading_true");
+  ReportDampingMetrics(Metrics, N2kDataToNMEA0183.GetDampedSOG(), "sog");
+  if (pNTPShm) {
+    tNTPShm::tStats TimeStats;
+    pNTPShm->GetStats(TimeStats);
+    Metrics.Add("ntpshm_samples_total", TimeStats.Samples);
+    Metrics.Add("ntpshm_offset_seconds", TimeStats.LastOffset);
+    Metrics.Add("ntpshm_jitter_seconds", TimeStats.Jitter);
+  }
+  if (!Metrics.Commit()) {
+    cerr << "Problem writing metrics file.\n";
+  }
+}
+
+// ******** ReportJitter ********
+// Prints summary of wake-up lateness for the last period
+void ReportJitter(const tLatencyHistogram& WakeJitter) {
+  cout << "Wake-up lateness over " << WakeJitter.GetCount() << " loops: "
+    << "mean " << WakeJitter.GetMean() << "us; "
+    << "p50 " << WakeJitter.GetPercentile(50) << "us; "
+    << "p99 " << WakeJitter.GetPercentile(99) << "us; "
+    << "p99.9 " << WakeJitter.GetPercentile(99.9) << "us; "
+    << "max " << WakeJitter.GetMax() << "us\n";
+}
+
+// ******** RunBridge ********
+// Bridge mode: forwards CAN frames over UDP to a converter elsewhere,
+// until stopped by a signal.
+int RunBridge(const string& can_port, const string& bridge_dest, unsigned can_rcvbuf_kb,
+              const string& metrics_file, unsigned metrics_period_s) {
+  tCANUDPBridge Bridge(can_port.c_str(), bridge_dest.c_str(), can_rcvbuf_kb*1024);
+  if (!Bridge.Open()) {
+    cerr << "Problem opening bridge. Exiting.\n";
+    return 3;
+  }
+  tMetricsFile Metrics(metrics_file.c_str());
+  tSystemdNotify SystemdNotify;
+  if (SystemdNotify.Open()) {
+    SystemdNotify.Ready();
+  }
+  tCANUDPBridge::tStats Stats;
+  auto report_time = chrono::steady_clock::now();
+  cout << "Bridging!\n";
+  while (run_program) {
+    Bridge.Poll(LoopPeriod.count());
+    if (SystemdNotify.KeepAliveDue()) {
+      SystemdNotify.KeepAlive();
+    }
+    auto time_now = chrono::steady_clock::now();
+    if (Metrics.IsEnabled() && time_now - report_time >= chrono::seconds(metrics_period_s)) {
+      Bridge.GetStats(Stats);
+      Metrics.Begin();
+      Metrics.Add("bridge_frames_forwarded_total", Stats.FramesForwarded);
+      Metrics.Add("bridge_datagrams_sent_total", Stats.DatagramsSent);
+      Metrics.Add("bridge_send_errors_total", Stats.SendErrors);
+      Metrics.Add("can_kernel_drops_total", Stats.KernelDrops);
+      if (!Metrics.Commit()) {
+        cerr << "Problem writing metrics file.\n";
+      }
+      report_time = time_now;
+    }
+  }
+  SystemdNotify.Stopping();
+  Bridge.GetStats(Stats);
+  cout << "Bridge finished. Frames: " << Stats.FramesForwarded
+    << "; datagrams: " << Stats.DatagramsSent << "; send errors: " << Stats.SendErrors << "\n";
+  return 0;
 }
 
 // ******** HandleSignal ********
@@ -158,21 +437,103 @@ int main(int argc, char* argv[]) {
   // Setup signal handler
   signal(SIGINT, HandleSignal);
   signal(SIGTERM, HandleSignal);
+  // Output reader going away is handled by the output sink, not by dying
+  signal(SIGPIPE, SIG_IGN);
   // Parse arguments from cmd line annd oad config file
-  string config_file, can_port, aux_in_serial, aux_in_baud, out_stream, fwd_stream;
+  string config_file, can_port, aux_in_serial, aux_in_baud, out_stream, fwd_stream, metrics_file;
+  string out_format, out2_stream, out2_format, coalesce_pgns, wmm_file, columns_file, analyzer_file;
+  string replay_file, heap_guard, udp_in, bridge_dest;
+  double replay_speed = 1.0;
+  double columns_period_s = 1.0;
+  unsigned can_rcvbuf_kb = 0;
+  unsigned out_buffer_kb = 0;
+  unsigned metrics_period_s = 0;
+  int ntp_shm_unit = -1;
   double depth_offset_ft = 0.0;
   bool debug_mode = false;
+  tRealtimeOptions realtime;
+  tDampingOptions damping = { 0, 0, 0, 0 };
   bool status_ok = false;
   status_ok = SetOptions(argc, argv, // inputs
-    &config_file, &can_port, &aux_in_serial, &aux_in_baud, &out_stream, &fwd_stream, &depth_offset_ft, &debug_mode); // outputs
+    &config_file, &can_port, &aux_in_serial, &aux_in_baud, &out_stream, &fwd_stream,
+    &out_format, &out2_stream, &out2_format,
+    &out_buffer_kb, &metrics_file, &metrics_period_s, &depth_offset_ft, &realtime, &damping,
+    &can_rcvbuf_kb, &udp_in, &bridge_dest, &replay_file, &replay_speed, &heap_guard, &ntp_shm_unit, &coalesce_pgns, &wmm_file,
+    &columns_file, &columns_period_s, &analyzer_file, &debug_mode); // outputs
   if (!status_ok) {
     cerr << "Problem loading options. Exiting.\n";
     return 3;
   }
+  // Bridge host does not convert anything
+  if (!bridge_dest.empty()) {
+    return RunBridge(can_port, bridge_dest, can_rcvbuf_kb, metrics_file, metrics_period_s);
+  }
+  tHeapGuardMode heap_guard_mode;
+  if (!ParseHeapGuardMode(heap_guard.c_str(), heap_guard_mode)) {
+    cerr << "Unknown heapguard mode: " << heap_guard << ". Exiting.\n";
+    return 3;
+  }
+  tOutputFormat out_fmt = of_NMEA0183;
+  tOutputFormat out2_fmt = of_SignalK;
+  if (!ParseOutputFormat(out_format, out_fmt) ||
+      (!out2_stream.empty() && !ParseOutputFormat(out2_format, out2_fmt))) {
+    cerr << "Unknown output format. Exiting.\n";
+    return 3;
+  }
+  if (!out2_stream.empty() && out_fmt == of_SignalK && out2_fmt == of_SignalK) {
+    cerr << "Signal K can only go to one output. Exiting.\n";
+    return 3;
+  }
+  tN2kCoalescer Coalescer;
+  if (!Coalescer.SetPGNs(coalesce_pgns.c_str())) {
+    cerr << "Bad coalesce PGN list: " << coalesce_pgns << ". Exiting.\n";
+    return 3;
+  }
+  // Coalesced time messages (GNSS 129029, system time 126992) would be fed
+  // with another message's receive time
+  for (size_t i = 0; ntp_shm_unit >= 0 && i < Coalescer.GetPGNCount(); i++) {
+    if (Coalescer.GetPGN(i) == 129029UL || Coalescer.GetPGN(i) == 126992UL) {
+      cerr << "PGN " << Coalescer.GetPGN(i) << " cannot be coalesced with the NTP SHM time feed"
+           << " (time PGNs 129029 and 126992). Exiting.\n";
+      return 3;
+    }
+  }
+  tMagneticModel MagneticModel;
+  if (!wmm_file.empty() && !MagneticModel.Load(wmm_file.c_str())) {
+    cerr << "Continuing without magnetic model.\n";
+  }
   // Create parsing objects
-  tNMEA2000_SocketCAN NMEA2000((char*)can_port.c_str());
-  tNMEA0183LinuxStream NMEA0183OutStream(out_stream.c_str());
-  tNMEA0183 NMEA0183Out(&NMEA0183OutStream);
+  tNMEA2000_CANSocket *pCANSocket = NULL;
+  tNMEA2000_CANUDP *pCANUDP = NULL;
+  tNMEA2000_CandumpReplay *pReplay = NULL;
+  if (!replay_file.empty()) {
+    pReplay = new tNMEA2000_CandumpReplay(replay_file.c_str());
+  } else if (!udp_in.empty()) {
+    pCANUDP = new tNMEA2000_CANUDP(udp_in.c_str(), can_rcvbuf_kb*1024);
+  } else {
+    pCANSocket = new tNMEA2000_CANSocket(can_port.c_str(), can_rcvbuf_kb*1024);
+  }
+  tNMEA2000& NMEA2000 = pReplay ? (tNMEA2000&)*pReplay
+                      : pCANUDP ? (tNMEA2000&)*pCANUDP : (tNMEA2000&)*pCANSocket;
+  // Shared sentence buffers, enough for full queues of all NMEA0183 outputs.
+  // Declared before the outputs, which release their sentences when closed.
+  size_t nmea0183_outputs = (out_fmt == of_NMEA0183 ? 1 : 0) +
+                            (!out2_stream.empty() && out2_fmt == of_NMEA0183 ? 1 : 0);
+  tSentencePool SentencePool(nmea0183_outputs * tNMEA0183AsyncSink::GetSentenceCapacity(out_buffer_kb*1024) + 1);
+  tNMEA0183AsyncSink OutSink(out_stream.c_str(), out_buffer_kb*1024);
+  tNMEA0183AsyncSink *pOut2Sink = NULL;
+  if (!out2_stream.empty()) {
+    pOut2Sink = new tNMEA0183AsyncSink(out2_stream.c_str(), out_buffer_kb*1024);
+  }
+  // Route Signal K to the output that asked for it, NMEA0183 to all others
+  tNMEA0183AsyncSink *pSignalKSink = NULL;
+  if (out_fmt == of_SignalK) {
+    pSignalKSink = &OutSink;
+  } else if (pOut2Sink && out2_fmt == of_SignalK) {
+    pSignalKSink = pOut2Sink;
+  }
+  tSignalKWriter SignalKOut(pSignalKSink);
+  tMetricsFile Metrics(metrics_file.c_str());
   // Optional aux input stream
   tNMEA0183LinuxStream *pNMEA0183AuxInStream = NULL;
   tNMEA0183 *pNMEA0183AuxIn = NULL;
@@ -180,43 +541,157 @@ int main(int argc, char* argv[]) {
     pNMEA0183AuxInStream = new tNMEA0183LinuxStream(aux_in_serial.c_str(), atoi(aux_in_baud.c_str()), true);
     pNMEA0183AuxIn = new tNMEA0183(pNMEA0183AuxInStream);
   }
-  tN2kDataToNMEA0183 N2kDataToNMEA0183(&NMEA2000, pNMEA0183AuxIn, &NMEA0183Out);
+  tN2kDataToNMEA0183 N2kDataToNMEA0183(&NMEA2000, pNMEA0183AuxIn, NULL);
+  if (out_fmt == of_NMEA0183) {
+    N2kDataToNMEA0183.AddSentenceSink(&SentencePool, &OutSink);
+  }
+  if (pOut2Sink && out2_fmt == of_NMEA0183) {
+    N2kDataToNMEA0183.AddSentenceSink(&SentencePool, pOut2Sink);
+  }
+  if (pSignalKSink) {
+    N2kDataToNMEA0183.SetSignalKOutput(&SignalKOut);
+  }
+  if (Coalescer.IsEnabled()) {
+    N2kDataToNMEA0183.SetCoalescer(&Coalescer);
+  }
+  if (MagneticModel.IsLoaded()) {
+    N2kDataToNMEA0183.SetMagneticModel(&MagneticModel);
+  }
+  tLoopMonitor LoopMonitor(chrono::duration_cast<chrono::microseconds>(LoopPeriod).count());
+  N2kDataToNMEA0183.SetLoopMonitor(&LoopMonitor);
   N2kDataToNMEA0183.SetDepthOffset(depth_offset_ft);
+  N2kDataToNMEA0183.SetDamping(damping);
+  tColumnWriter ColumnOut;
+  if (!columns_file.empty()) {
+    if (ColumnOut.Open(columns_file.c_str(), tN2kDataToNMEA0183::ColumnNames, tN2kDataToNMEA0183::col_Count)) {
+      // Replayed stretches without GNSS time are skipped, not stamped with today
+      N2kDataToNMEA0183.SetColumnOutput(&ColumnOut, (unsigned long)(columns_period_s * 1000), pReplay == NULL);
+    } else {
+      cerr << "Continuing without time series output.\n";
+    }
+  }
+  // Optional bus analysis, sees frames only on a CAN socket
+  tBusAnalyzer *pBusAnalyzer = NULL;
+  tMetricsFile *pAnalyzerMetrics = NULL;
+  if (!analyzer_file.empty()) {
+    if (pCANSocket) {
+      pBusAnalyzer = new tBusAnalyzer();
+      pAnalyzerMetrics = new tMetricsFile(analyzer_file.c_str(), tBusAnalyzer::ReportSize);
+      pCANSocket->SetAnalyzer(pBusAnalyzer);
+    } else {
+      cerr << "Bus analysis needs CAN port input. Continuing without it.\n";
+    }
+  }
+  // Optional NTP SHM time feed. Replayed frames have no meaningful receive time.
+  if (ntp_shm_unit >= 0 && pCANSocket) {
+    pNTPShm = new tNTPShm(ntp_shm_unit);
+    if (pNTPShm->Open()) {
+      pTimeSource = pCANSocket;
+      N2kDataToNMEA0183.SetGNSSTimeCallback(HandleGNSSTime);
+    } else {
+      cerr << "Continuing without NTP SHM time feed.\n";
+    }
+  }
   // Optional forward stream
   tSocketStream *pForwardStream = NULL;
   if (!fwd_stream.empty()) {
     pForwardStream = new tSocketStream(fwd_stream.c_str());
   }
   // Setup parsing objects
-  status_ok = Setup(NMEA2000, pNMEA0183AuxIn, NMEA0183Out, N2kDataToNMEA0183, pForwardStream);
+  status_ok = Setup(NMEA2000, pNMEA0183AuxIn, OutSink, pOut2Sink,
+                    N2kDataToNMEA0183, pForwardStream);
   if (!status_ok) {
     cerr << "Problem during Setup. Exiting.\n";
     delete pForwardStream;
     delete pNMEA0183AuxIn;
     delete pNMEA0183AuxInStream;
+    delete pCANSocket;
+    delete pCANUDP;
+    delete pReplay;
+    delete pNTPShm;
+    delete pBusAnalyzer;
+    delete pAnalyzerMetrics;
+    delete pOut2Sink;
     return 3;
   }
+  // Real-time settings come last, so that setup allocations are locked in
+  pthread_t writer_threads[2] = { OutSink.GetWriterThread() };
+  size_t writer_thread_count = 1;
+  if (pOut2Sink) writer_threads[writer_thread_count++] = pOut2Sink->GetWriterThread();
+  if (!ApplyRealtimeOptions(realtime, writer_threads, writer_thread_count)) {
+    cerr << "Some real-time settings could not be applied. Continuing without them.\n";
+  }
+  // Tell systemd we are up, watchdog keep-alives follow from the loop
+  tSystemdNotify SystemdNotify;
+  if (SystemdNotify.Open()) {
+    SystemdNotify.Ready();
+  }
   // Set current time for measurements
   sched_time = chrono::steady_clock::now();
   // Debug time vars
   auto debug_time = sched_time;
   auto start_parse_time = sched_time;
+  auto report_time = sched_time;
+  auto analyzer_time = sched_time;
+  // Replay time follows wall clock from the first frame
+  uint64_t replay_origin_us = pReplay ? pReplay->GetNextFrameTime() : 0;
+  auto replay_start = sched_time;
   
   // **** Main Program Loop ****
   cout << "Running!\n";
+  // Everything the loop needs must be allocated by now
+  HeapGuardSetSteadyState(heap_guard_mode);
   while (run_program) {
     // Wait until trigger to parse/send
-    WaitForEvent();
+    uint32_t wake_late_us = WaitForEvent();
+    LoopMonitor.BeginIteration(wake_late_us);
     // Debug timing
     if (debug_mode) {
       start_parse_time = chrono::steady_clock::now();
     }
+    // Release frames up to current replay time
+    if (pReplay) {
+      if (replay_speed > 0) {
+        auto elapsed_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - replay_start).count();
+        pReplay->ReleaseUntil(replay_origin_us + (uint64_t)(elapsed_us * replay_speed));
+      } else {
+        pReplay->ReleaseAll();
+      }
+    }
     // Parse NMEA2000 and send NMEA0183Out
     NMEA2000.ParseMessages();
+    LoopMonitor.Checkpoint("CAN receive");
     if (pNMEA0183AuxIn) {
       pNMEA0183AuxIn->ParseMessages();
+      LoopMonitor.Checkpoint("aux input");
     }
     N2kDataToNMEA0183.Update();
+    LoopMonitor.Checkpoint("output update");
+    if (pReplay && pReplay->AtEnd()) {
+      run_program = false;
+    }
+    // Bus analysis every second
+    if (pBusAnalyzer && sched_time - analyzer_time >= chrono::seconds(1)) {
+      ReportBusAnalysis(*pAnalyzerMetrics, *pBusAnalyzer, *pCANSocket,
+                        chrono::duration<double>(sched_time - analyzer_time).count());
+      analyzer_time = sched_time;
+      LoopMonitor.Checkpoint("analyzer");
+    }
+    // Periodic metrics and reports
+    if (sched_time - report_time >= chrono::seconds(metrics_period_s)) {
+      const tLatencyHistogram* pWakeJitter = realtime.MeasureJitter ? &LoopMonitor.GetWakeLateHistogram() : NULL;
+      if (Metrics.IsEnabled()) {
+        ReportMetrics(Metrics, pCANSocket, pCANUDP, OutSink, pOut2Sink, pSignalKSink ? &SignalKOut : NULL, SentencePool,
+                      LoopMonitor, pWakeJitter, pTimeSource ? pNTPShm : NULL, Coalescer, MagneticModel,
+                      ColumnOut, N2kDataToNMEA0183);
+      }
+      if (pWakeJitter) {
+        ReportJitter(*pWakeJitter);
+      }
+      LoopMonitor.ResetHistograms();
+      report_time = sched_time;
+      LoopMonitor.Checkpoint("metrics");
+    }
     // Debug timing and prints
     if (debug_mode) {
       auto time_now = chrono::steady_clock::now();
@@ -229,10 +704,48 @@ int main(int argc, char* argv[]) {
         << "Usage: " << usage << "%\n";
       debug_time = time_now;
     }
+    LoopMonitor.EndIteration();
+    // Keep-alive only, if loop passes still complete. Overruns are left to
+    // metrics and log.
+    if (SystemdNotify.KeepAliveDue() && LoopMonitor.TakeProgress()) {
+      SystemdNotify.KeepAlive();
+    }
+  }
+  SystemdNotify.Stopping();
+  uint64_t steady_allocations = HeapGuardSteadyAllocations();
+  HeapGuardSetSteadyState(hgm_Off);
+  if (pReplay) {
+    cout << "Replay finished. Frames: " << pReplay->GetFramesRead()
+      << "; unparsed lines: " << pReplay->GetBadLines() << "\n";
+  }
+  if (Coalescer.IsEnabled()) {
+    uint64_t coalesced = 0;
+    for (size_t i = 0; i < Coalescer.GetPGNCount(); i++) {
+      coalesced += Coalescer.GetCoalescedCount(i);
+    }
+    cout << "Coalesced messages: " << coalesced << "\n";
+  }
+  tLoopMonitor::tStats LoopStats;
+  LoopMonitor.GetStats(LoopStats);
+  cout << "Loop overruns: " << LoopStats.Overruns << "; missed slots: " << LoopStats.MissedSlots << "\n";
+  if (heap_guard_mode != hgm_Off) {
+    cout << "Heap allocations after steady state: " << steady_allocations << "\n";
   }
   cout << "Exiting.\n";
+  OutSink.Close();
+  ColumnOut.Close();
+  if (pOut2Sink) {
+    pOut2Sink->Close();
+  }
   delete pForwardStream;
   delete pNMEA0183AuxIn;
   delete pNMEA0183AuxInStream;
+  delete pCANSocket;
+  delete pCANUDP;
+  delete pReplay;
+  delete pNTPShm;
+  delete pBusAnalyzer;
+  delete pAnalyzerMetrics;
+  delete pOut2Sink;
   return 0;
 }
\ No newline at end of file
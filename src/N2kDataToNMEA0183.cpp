@@ -25,6 +25,7 @@ OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <N2kMessages.h>
 #include <NMEA0183Messages.h>
 #include <math.h>
+#include <time.h>
 
 const double radToDeg=180.0/M_PI;
 const double mToFeet=3.2808398950131;
@@ -32,17 +33,40 @@ const double mToFeet=3.2808398950131;
 //*****************************************************************************
 // Handle incoming NMEA2000 messages
 void tN2kDataToNMEA0183::HandleMsg(const tN2kMsg &N2kMsg) {
+  // High rate messages wait for end of cycle, where only the newest is used
+  if ( pCoalescer!=0 && pCoalescer->Add(N2kMsg) ) return;
+  ConvertMsg(N2kMsg);
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::HandleCoalesced() {
+  if ( pCoalescer==0 ) return;
+  for (size_t i=0; i<pCoalescer->GetPendingCount(); i++) {
+    ConvertMsg(pCoalescer->GetPending(i));
+  }
+  pCoalescer->Clear();
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::ConvertMsg(const tN2kMsg &N2kMsg) {
   switch (N2kMsg.PGN) {
-    case 127250UL: HandleHeading(N2kMsg);
-    case 127258UL: HandleVariation(N2kMsg);
-    case 128259UL: HandleBoatSpeed(N2kMsg);
-    case 128267UL: HandleDepth(N2kMsg);
-    case 129025UL: HandlePosition(N2kMsg);
-    case 129026UL: HandleCOGSOG(N2kMsg);
-    case 129029UL: HandleGNSS(N2kMsg);
-    case 130306UL: HandleWind(N2kMsg);
-    case 130311UL: HandleEnvParams(N2kMsg);
+    case 127250UL: HandleHeading(N2kMsg); break;
+    case 127258UL: HandleVariation(N2kMsg); break;
+    case 128259UL: HandleBoatSpeed(N2kMsg); break;
+    case 128267UL: HandleDepth(N2kMsg); break;
+    case 129025UL: HandlePosition(N2kMsg); break;
+    case 129026UL: HandleCOGSOG(N2kMsg); break;
+    case 129029UL: HandleGNSS(N2kMsg); break;
+    case 130306UL: HandleWind(N2kMsg); break;
+    case 130311UL: HandleEnvParams(N2kMsg); break;
+    case 129038UL: HandleAISClassAPosition(N2kMsg); break;
+    case 129039UL: HandleAISClassBPosition(N2kMsg); break;
+    case 129794UL: HandleAISClassAStatic(N2kMsg); break;
+    case 129809UL: HandleAISClassBStaticA(N2kMsg); break;
+    case 129810UL: HandleAISClassBStaticB(N2kMsg); break;
+    case 126992UL: HandleSystemTime(N2kMsg); break;
   }
+  if ( pLoopMonitor!=0 ) pLoopMonitor->Checkpoint("PGN",N2kMsg.PGN);
 }
 
 //*****************************************************************************
@@ -56,33 +80,193 @@ void tN2kDataToNMEA0183::HandleMsg(const tNMEA0183Msg &NMEA0183Msg) {
 
 //*****************************************************************************
 void tN2kDataToNMEA0183::Update() {
+  HandleCoalesced();
   SendRMC();
-  if (LastHeadingMagSensorTime+2000 < millis()) { 
+  // Expire inputs. Derived values follow, when they are read next time.
+  if (LastHeadingMagSensorTime+2000 < Now() && !N2kIsNA(HeadingMagSensor)) { 
     HeadingMagSensor = N2kDoubleNA;
-    UpdateHeadingsNewMagnetic(); // Update dependent variables accordingly
+    InputChanged(dvi_HeadingMagSensor);
   }
-  if (LastHeadingTrueSensorTime+2000 < millis()) { 
+  if (LastHeadingTrueSensorTime+2000 < Now() && !N2kIsNA(HeadingTrueSensor)) { 
     HeadingTrueSensor = N2kDoubleNA; 
-    UpdateHeadingsNewTrue(); // Update dependent variables accordingly
+    InputChanged(dvi_HeadingTrueSensor);
   }
-  if (LastMagDeviationTime+4000 < millis()) { Deviation=N2kDoubleNA; }
-  if (LastMagVariationTime+4000 < millis()) { Variation=N2kDoubleNA; }
-  if (LastCOGSOGTime+2000<millis()) { COG=N2kDoubleNA; SOG=N2kDoubleNA; }
-  if (LastPositionTime+4000<millis()) { Latitude=N2kDoubleNA; Longitude=N2kDoubleNA; }
-  if (LastWindTime+2000<millis()) {
+  if (LastMagDeviationTime+4000 < Now() && !N2kIsNA(Deviation)) {
+    Deviation=N2kDoubleNA;
+    InputChanged(dvi_Deviation);
+  }
+  if (LastMagVariationTime+4000 < Now() && !N2kIsNA(Variation)) {
+    Variation=N2kDoubleNA;
+    InputChanged(dvi_Variation);
+  }
+  if (LastCOGSOGTime+2000<Now() && !(N2kIsNA(COGSensor) && N2kIsNA(SOG))) {
+    COGSensor=N2kDoubleNA; SOG=N2kDoubleNA;
+    InputChanged(dvi_COG | dvi_SOG);
+  }
+  if (LastPositionTime+4000<Now()) { Latitude=N2kDoubleNA; Longitude=N2kDoubleNA; }
+  if (LastWindTime+2000<Now() && !(N2kIsNA(WindSpeedApp) && N2kIsNA(WindAngleApp))) {
     WindSpeedApp = N2kDoubleNA;
     WindAngleApp = N2kDoubleNA;
-    WindSpeedTrue = N2kDoubleNA;
-    WindDirTrue = N2kDoubleNA;
+    InputChanged(dvi_WindApparent);
+  }
+  UpdateModelVariation();
+  UpdateDamping();
+  WriteColumns();
+  SendSignalK();
+}
+
+//*****************************************************************************
+// Model variation for current position. Model caches the value, so this is
+// cheap until we have moved far enough or the day changes.
+void tN2kDataToNMEA0183::UpdateModelVariation() {
+  if ( pMagneticModel==0 ) return;
+  double _ModelVariation=N2kDoubleNA;
+  if ( !N2kIsNA(Latitude) && !N2kIsNA(Longitude) ) {
+    // Without GNSS date, system clock is good enough for the model
+    uint16_t Days=(DaysSince1970!=N2kUInt16NA) ? DaysSince1970 : time(0)/86400;
+    _ModelVariation=pMagneticModel->GetVariation(Latitude,Longitude,Days);
+  }
+  if ( _ModelVariation!=ModelVariation ) {
+    ModelVariation=_ModelVariation;
+    if ( N2kIsNA(Variation) ) {
+      InputChanged(dvi_Variation);
+      SignalKChanged |= skv_Variation;
+    }
+  }
+}
+
+//*****************************************************************************
+static inline bool IsAvailable(double Value) {
+  return !N2kIsNA(Value) && !NMEA0183IsNA(Value);
+}
+
+//*****************************************************************************
+// Current values go to damping windows once per update, so the cost does
+// not depend on message rates and samples are evenly spaced in time.
+void tN2kDataToNMEA0183::UpdateDamping() {
+  unsigned long _Now=Now();
+  if ( DampedWindAngleApp.IsEnabled() ) {
+    if ( IsAvailable(WindAngleApp) ) DampedWindAngleApp.Add(WindAngleApp,_Now); else DampedWindAngleApp.Expire(_Now);
+    if ( IsAvailable(WindSpeedApp) ) DampedWindSpeedApp.Add(WindSpeedApp,_Now); else DampedWindSpeedApp.Expire(_Now);
+    if ( IsAvailable(GetWindDirTrue()) ) DampedWindDirTrue.Add(WindDirTrue,_Now); else DampedWindDirTrue.Expire(_Now);
+    if ( IsAvailable(GetWindSpeedTrue()) ) DampedWindSpeedTrue.Add(WindSpeedTrue,_Now); else DampedWindSpeedTrue.Expire(_Now);
+  }
+  if ( DampedHeadingTrue.IsEnabled() ) {
+    if ( IsAvailable(GetHeadingTrue()) ) DampedHeadingTrue.Add(HeadingTrue,_Now); else DampedHeadingTrue.Expire(_Now);
+  }
+  if ( DampedSOG.IsEnabled() ) {
+    if ( IsAvailable(SOG) ) DampedSOG.Add(SOG,_Now); else DampedSOG.Expire(_Now);
+  }
+  if ( HasDampedOutput() && NextDampedSend<=_Now ) {
+    NextDampedSend=(_Now/DampedOutputPeriod+1)*DampedOutputPeriod;
+    if ( HasNMEA0183Output() ) SendDamped();
   }
 }
 
+//*****************************************************************************
+// Values without a damping window are sent as they are
+static inline double Damped(const tRollingScalar &Window, double Value) {
+  return Window.IsEnabled() ? Window.GetMean() : Value;
+}
+
+static inline double Damped(const tRollingAngle &Window, double Value) {
+  return Window.IsEnabled() ? Window.GetMean() : Value;
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::SendDamped() {
+  tNMEA0183Msg NMEA0183Msg;
+  double Angle=Damped(DampedWindAngleApp,WindAngleApp);
+  double Speed=Damped(DampedWindSpeedApp,WindSpeedApp);
+  if ( IsAvailable(Angle) && IsAvailable(Speed) &&
+       NMEA0183SetMWV(NMEA0183Msg,WrapAngle(Angle)*radToDeg,NMEA0183Wind_Apparent,Speed) ) {
+    SendMessage(NMEA0183Msg);
+  }
+  Angle=Damped(DampedWindDirTrue,GetWindDirTrue());
+  Speed=Damped(DampedWindSpeedTrue,GetWindSpeedTrue());
+  if ( IsAvailable(Angle) && IsAvailable(Speed) ) {
+    double _Variation=GetVariation();
+    double WindDirMag_deg=IsAvailable(_Variation) ? WrapAngle(Angle-_Variation)*radToDeg : N2kDoubleNA;
+    if ( NMEA0183SetMWD(NMEA0183Msg,WrapAngle(Angle)*radToDeg,WindDirMag_deg,Speed) ) {
+      SendMessage(NMEA0183Msg);
+    }
+  }
+  Angle=Damped(DampedHeadingTrue,GetHeadingTrue());
+  if ( IsAvailable(Angle) && NMEA0183SetHDT(NMEA0183Msg,WrapAngle(Angle)) ) {
+    SendMessage(NMEA0183Msg);
+  }
+  Speed=Damped(DampedSOG,SOG);
+  if ( IsAvailable(Speed) && NMEA0183SetVTG(NMEA0183Msg,GetCOG(),GetMCOG(),Speed) ) {
+    SendMessage(NMEA0183Msg);
+  }
+}
+
+//*****************************************************************************
+// One row of current values on a fixed grid. Grid is kept also without
+// output, so output can be attached later. Rows without known time are
+// skipped.
+void tN2kDataToNMEA0183::WriteColumns() {
+  if ( NextColumnRow>Now() ) return;
+  NextColumnRow=(Now()/ColumnPeriod+1)*ColumnPeriod;
+  if ( pColumnOut==0 ) return;
+  int64_t Time_us=GetUTCTime_us();
+  if ( Time_us==0 ) return;
+  double Values[col_Count];
+  Values[col_Latitude]=Latitude;
+  Values[col_Longitude]=Longitude;
+  Values[col_COG]=GetCOG();
+  Values[col_SOG]=SOG;
+  Values[col_HeadingTrue]=GetHeadingTrue();
+  Values[col_HeadingMagnetic]=GetHeadingMagnetic();
+  Values[col_WindAngleApp]=WindAngleApp;
+  Values[col_WindSpeedApp]=WindSpeedApp;
+  Values[col_WindDirTrue]=GetWindDirTrue();
+  Values[col_WindSpeedTrue]=GetWindSpeedTrue();
+  Values[col_SpeedThroughWater]=SpeedThroughWater;
+  Values[col_Depth]=DepthBelowTransducer;
+  Values[col_WaterTemperature]=WaterTemperature;
+  for (int i=0; i<col_Count; i++) {
+    if ( !IsAvailable(Values[i]) ) Values[i]=NAN;
+  }
+  pColumnOut->AddRow(Time_us,Values);
+}
+
 //*****************************************************************************
 void tN2kDataToNMEA0183::SendMessage(const tNMEA0183Msg &NMEA0183Msg) {
   if ( pNMEA0183Out!=0 ) pNMEA0183Out->SendMessage(NMEA0183Msg);
   if ( SendNMEA0183MessageCallback!=0 ) SendNMEA0183MessageCallback(NMEA0183Msg);
+  if ( SentenceSinkCount>0 ) {
+    tSentence *pSentence=pSentencePool->Format(NMEA0183Msg);
+    if ( pSentence==0 ) return;
+    for (size_t i=0; i<SentenceSinkCount; i++) {
+      SentenceSinks[i]->SendSentence(pSentence);
+    }
+    pSentence->Release();
+  }
 }
 
+//*****************************************************************************
+// Derived values and the inputs they depend on, directly or through other
+// derived values. A change of any input marks the value dirty.
+const uint32_t tN2kDataToNMEA0183::DerivedInputs[dv_Count] = {
+  /* dv_Headings */ dvi_HeadingMagSensor | dvi_HeadingTrueSensor | dvi_Deviation | dvi_Variation,
+  /* dv_COG */ dvi_COG | dvi_Variation,
+  /* dv_TrueWind */ dvi_HeadingMagSensor | dvi_HeadingTrueSensor | dvi_Deviation | dvi_Variation
+                    | dvi_COG | dvi_SOG | dvi_WindApparent
+};
+
+const char * const tN2kDataToNMEA0183::ColumnNames[col_Count] = {
+  "latitude", "longitude", "cog", "sog", "heading_true", "heading_magnetic",
+  "wind_angle_apparent", "wind_speed_apparent", "wind_direction_true", "wind_speed_true",
+  "stw", "depth", "water_temperature"
+};
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::InputChanged(uint32_t Inputs) {
+  for (int i=0; i<dv_Count; i++) {
+    if ( DerivedInputs[i] & Inputs ) DerivedDirty |= 1<<i;
+  }
+}
 //*****************************************************************************
 void tN2kDataToNMEA0183::HandleHeading(const tN2kMsg &N2kMsg) {
 unsigned char SID;
@@ -93,24 +277,29 @@ double _Deviation, _Variation, _Heading;
     if (ref == N2khr_magnetic) {
       if (!NMEA0183IsNA(_Heading)) {
         HeadingMagSensor=_Heading; // Update magnetic sensor heading
-        LastHeadingMagSensorTime = millis();
+        LastHeadingMagSensorTime = Now();
+        HeadingTrueControlling = false;
+        InputChanged(dvi_HeadingMagSensor);
       }
       if (!NMEA0183IsNA(_Variation)) {
         Variation=_Variation; // Update Variation
-        LastMagVariationTime = millis();
+        LastMagVariationTime = Now();
+        InputChanged(dvi_Variation);
       }
       if (!NMEA0183IsNA(_Deviation)) {
         Deviation=_Deviation; // Update Deviation
-        LastMagDeviationTime = millis();
+        LastMagDeviationTime = Now();
+        InputChanged(dvi_Deviation);
       }
-      UpdateHeadingsNewMagnetic();
+      SignalKChanged |= skv_HeadingMagnetic | skv_HeadingTrue | skv_Variation;
+      if (!HasNMEA0183Output()) return;
       // Send HDG message
       tNMEA0183Msg NMEA0183MsgHDG;
-      if (NMEA0183SetHDG(NMEA0183MsgHDG, HeadingMagSensor, Deviation, Variation)) {
+      if (NMEA0183SetHDG(NMEA0183MsgHDG, HeadingMagSensor, Deviation, GetVariation())) {
         SendMessage(NMEA0183MsgHDG);
       }
       // Send HDT as well if we have the right data
-      if (!N2kIsNA(HeadingTrue)) {
+      if (!HasDampedOutput() && !N2kIsNA(GetHeadingTrue())) {
         tNMEA0183Msg NMEA0183MsgHDT;
         if (NMEA0183SetHDT(NMEA0183MsgHDT, HeadingTrue)) {
           SendMessage(NMEA0183MsgHDT);
@@ -119,12 +308,15 @@ double _Deviation, _Variation, _Heading;
     } else if (ref == N2khr_true) {
       if (!N2kIsNA(_Heading)) {
         HeadingTrueSensor = _Heading; // Update true heading
-        LastHeadingTrueSensorTime = millis();
+        LastHeadingTrueSensorTime = Now();
+        HeadingTrueControlling = true;
+        InputChanged(dvi_HeadingTrueSensor);
       }
-      UpdateHeadingsNewTrue();
+      SignalKChanged |= skv_HeadingMagnetic | skv_HeadingTrue;
+      if (!HasNMEA0183Output() || HasDampedOutput()) return;
       // Send HDT message
       tNMEA0183Msg NMEA0183MsgHDT;
-      if (NMEA0183SetHDT(NMEA0183MsgHDT, HeadingTrue)) {
+      if (NMEA0183SetHDT(NMEA0183MsgHDT, GetHeadingTrue())) {
         SendMessage(NMEA0183MsgHDT);
       }
     }
@@ -138,24 +330,29 @@ void tN2kDataToNMEA0183::HandleHeadingNMEA0183(const tNMEA0183Msg &NMEA0183Msg)
   if (NMEA0183ParseHDG_nc(NMEA0183Msg, _Heading, _Deviation, _Variation)) {
     if (!NMEA0183IsNA(_Heading)) {
       HeadingMagSensor=_Heading; // Update magnetic sensor heading
-      LastHeadingMagSensorTime = millis();
+      LastHeadingMagSensorTime = Now();
+      HeadingTrueControlling = false;
+      InputChanged(dvi_HeadingMagSensor);
     }
     if (!NMEA0183IsNA(_Variation)) {
       Variation=_Variation; // Update Variation
-      LastMagVariationTime = millis();
+      LastMagVariationTime = Now();
+      InputChanged(dvi_Variation);
     }
     if (!NMEA0183IsNA(_Deviation)) {
       Deviation=_Deviation; // Update Deviation
-      LastMagDeviationTime = millis();
+      LastMagDeviationTime = Now();
+      InputChanged(dvi_Deviation);
     }
-    UpdateHeadingsNewMagnetic();
+    SignalKChanged |= skv_HeadingMagnetic | skv_HeadingTrue | skv_Variation;
+    if (!HasNMEA0183Output()) return;
     // Send HDG message
     tNMEA0183Msg NMEA0183MsgHDG;
-    if (NMEA0183SetHDG(NMEA0183MsgHDG, HeadingMagSensor, Deviation, Variation)) {
+    if (NMEA0183SetHDG(NMEA0183MsgHDG, HeadingMagSensor, Deviation, GetVariation())) {
       SendMessage(NMEA0183MsgHDG);
     }
     // Send HDT as well if we have the right data
-    if (!N2kIsNA(HeadingTrue)) {
+    if (!HasDampedOutput() && !N2kIsNA(GetHeadingTrue())) {
       tNMEA0183Msg NMEA0183MsgHDT;
       if (NMEA0183SetHDT(NMEA0183MsgHDT, HeadingTrue)) {
         SendMessage(NMEA0183MsgHDT);
@@ -164,77 +361,68 @@ void tN2kDataToNMEA0183::HandleHeadingNMEA0183(const tNMEA0183Msg &NMEA0183Msg)
   }
 }
 
-void tN2kDataToNMEA0183::UpdateHeadingsNewMagnetic() {
-  // This function is called with the magnetic sensor heading is updated and
-  // it is the *controlling* source, so the others are calculated from it.
-  // Updates include timeout expirations (see 2 sec timeout above)
-  if (!N2kIsNA(HeadingMagSensor) && !NMEA0183IsNA(HeadingMagSensor)) {
-    // We have a valid Mag reading. Good.
-    // Start with our magnetic sensor reading, assuming no deviation
-    HeadingMagnetic = HeadingMagSensor;
-    // If we have deviation, add it to the sensor reading to correct it
-    if (!N2kIsNA(Deviation) && !NMEA0183IsNA(Deviation)) {
-      HeadingMagnetic = WrapAngle(HeadingMagnetic + Deviation);
-    }
-    // If we have variation, add it to the mag heading to get true
-    if (!N2kIsNA(Variation) && !NMEA0183IsNA(Variation)) { 
-      HeadingTrue = WrapAngle(HeadingMagnetic + Variation);
+//*****************************************************************************
+// Magnetic and true heading from sensors. The sensor which updated last is
+// the controlling one, the other heading is calculated from it. If it has
+// expired, the other sensor is used.
+void tN2kDataToNMEA0183::CalcHeadings() {
+  bool MagAvailable = IsAvailable(HeadingMagSensor);
+  bool TrueAvailable = IsAvailable(HeadingTrueSensor);
+  double _Variation = GetVariation();
+  bool VariationAvailable = IsAvailable(_Variation);
+  // Magnetic sensor reading corrected with deviation, if we have it
+  double MagCorrected = N2kDoubleNA;
+  if (MagAvailable) {
+    MagCorrected = IsAvailable(Deviation) ? WrapAngle(HeadingMagSensor + Deviation) : HeadingMagSensor;
+  }
+  if (TrueAvailable && (HeadingTrueControlling || !MagAvailable)) {
+    HeadingTrue = HeadingTrueSensor;
+    HeadingMagnetic = VariationAvailable ? WrapAngle(HeadingTrue - _Variation) : MagCorrected;
+  } else if (MagAvailable) {
+    HeadingMagnetic = MagCorrected;
+    if (VariationAvailable) {
+      HeadingTrue = WrapAngle(HeadingMagnetic + _Variation);
+    } else {
+      HeadingTrue = TrueAvailable ? HeadingTrueSensor : N2kDoubleNA;
     }
   } else {
-    // Must have an expired mag sensor reading. This creates a few problems.
-    // 1) HeadingMagnetic can be retrieved from the mag sensor, or true sensor minus variation.
-    //    So if true or variation are also gone, we have no HeadingMagnetic
-    // 2) HeadingTrue can be retrieved from the true sensor, or mag sensor plus variation.
-    //    So if true sensor is also gone, we have no HeadingTrue
-    if (N2kIsNA(HeadingTrueSensor) || NMEA0183IsNA(HeadingTrueSensor)) {
-      // Case 2)
-      HeadingTrue = N2kDoubleNA;
-    } else if (N2kIsNA(Variation) || NMEA0183IsNA(Variation)) {
-      // Case 1)
-      HeadingMagnetic = N2kDoubleNA;
-    }
+    HeadingMagnetic = N2kDoubleNA;
+    HeadingTrue = N2kDoubleNA;
   }
+  DerivedDirty &= ~(1<<dv_Headings);
 }
 
-void tN2kDataToNMEA0183::UpdateHeadingsNewTrue() {
-  // This function is called with the true heading is updated and
-  // it is the *controlling* source, so the mag heading is calculated from it.
-  // In reality this is probably never used, unless you have a sensor 
-  // which is specifically a GPS based true heading sensor.
-  // Note, Deviation is not touched here as there is no point to "back calculate"
-  // A magnetic sensor value. We only care about magnetic heading.
-  if (!N2kIsNA(HeadingTrueSensor) && !NMEA0183IsNA(HeadingTrueSensor)) {
-    // True heading is good. We can begin to use this.
-    HeadingTrue = HeadingTrueSensor;
-    // If we have variation, subtract it from the true heading to get magnetic    
-    if (!N2kIsNA(Variation) && !NMEA0183IsNA(Variation)) { 
-      HeadingMagnetic = WrapAngle(HeadingTrue - Variation);
-    }
+//*****************************************************************************
+// True and magnetic COG from whichever was received
+void tN2kDataToNMEA0183::CalcCOG() {
+  double _Variation = GetVariation();
+  bool VariationAvailable = IsAvailable(_Variation);
+  if (N2kIsNA(COGSensor)) {
+    COG = N2kDoubleNA;
+    MCOG = N2kDoubleNA;
+  } else if (COGSensorMagnetic) {
+    MCOG = COGSensor;
+    COG = VariationAvailable ? WrapAngle(MCOG + _Variation) : N2kDoubleNA;
   } else {
-    // Must have an expired true sensor reading. This creates a few problems.
-    // 1) HeadingTrue can be retrieved from the true sensor, or mag sensor plus variation.
-    //    So if mag or variation are also gone, we have no HeadingTrue
-    // 2) HeadingMagnetic can be retrieved from the mag sensor, or true sensor minus variation.
-    //    So if mag sensor is also gone, we have no HeadingMagnetic
-    if (N2kIsNA(HeadingMagSensor) || NMEA0183IsNA(HeadingMagSensor)) {
-      // Case 2)
-      HeadingMagnetic = N2kDoubleNA;
-    } else if (N2kIsNA(Variation) || NMEA0183IsNA(Variation)) {
-      // Case 1)
-      HeadingTrue = N2kDoubleNA;
-    }
+    COG = COGSensor;
+    MCOG = VariationAvailable ? WrapAngle(COG - _Variation) : N2kDoubleNA;
   }
+  DerivedDirty &= ~(1<<dv_COG);
 }
 
 //*****************************************************************************
 void tN2kDataToNMEA0183::HandleVariation(const tN2kMsg &N2kMsg) {
   unsigned char SID;
   tN2kMagneticVariation Source;
+  // Date of the variation model, not of now. Must not replace GNSS date.
+  uint16_t ModelDaysSince1970;
   double _Variation;
-  if (ParseN2kMagneticVariation(N2kMsg,SID,Source,DaysSince1970,_Variation)) {
+  if (ParseN2kMagneticVariation(N2kMsg,SID,Source,ModelDaysSince1970,_Variation)) {
     if (!N2kIsNA(_Variation)) {
       Variation = _Variation; // Update Variation
-      LastMagVariationTime = millis();
+      LastMagVariationTime = Now();
+      InputChanged(dvi_Variation);
+      SignalKChanged |= skv_Variation;
     }
   }
 }
@@ -247,8 +435,11 @@ double GroundReferenced;
 tN2kSpeedWaterReferenceType SWRT;
 
   if ( ParseN2kBoatSpeed(N2kMsg,SID,WaterReferenced,GroundReferenced,SWRT) ) {
+    SpeedThroughWater=WaterReferenced;
+    SignalKChanged |= skv_SpeedThroughWater;
+    if ( !HasNMEA0183Output() ) return;
     tNMEA0183Msg NMEA0183Msg;
-    if ( NMEA0183SetVHW(NMEA0183Msg,HeadingTrue,HeadingMagnetic,WaterReferenced) ) {
+    if ( NMEA0183SetVHW(NMEA0183Msg,GetHeadingTrue(),GetHeadingMagnetic(),WaterReferenced) ) {
       SendMessage(NMEA0183Msg);
     }
   }
@@ -257,11 +448,11 @@ tN2kSpeedWaterReferenceType SWRT;
 //*****************************************************************************
 void tN2kDataToNMEA0183::HandleDepth(const tN2kMsg &N2kMsg) {
 unsigned char SID;
-double DepthBelowTransducer;
 double Offset;
 double Range;
 
   if ( ParseN2kWaterDepth(N2kMsg,SID,DepthBelowTransducer,Offset,Range) ) {
+      SignalKChanged |= skv_Depth;
       tNMEA0183Msg NMEA0183Msg;
       // If user here has set a depth offset, apply it as well
       if (DepthOffset_ft != N2kDoubleNA)
@@ -282,7 +473,8 @@ void tN2kDataToNMEA0183::HandlePosition(const tN2kMsg &N2kMsg) {
     if ( NMEA0183SetGLL(NMEA0183Msg, SecondsSinceMidnight, Latitude, Longitude) ) {
       SendMessage(NMEA0183Msg);
     }
-    LastPositionTime=millis();
+    LastPositionTime=Now();
+    SignalKChanged |= skv_Position;
   }
 }
 
@@ -292,16 +484,13 @@ unsigned char SID;
 tN2kHeadingReference HeadingReference;
 tNMEA0183Msg NMEA0183Msg;
 
-  if ( ParseN2kCOGSOGRapid(N2kMsg,SID,HeadingReference,COG,SOG) ) {
-    LastCOGSOGTime=millis();
-    double MCOG = (!N2kIsNA(COG) && !N2kIsNA(Variation))
-      ? WrapAngle(COG - Variation)
-      : NMEA0183DoubleNA;
-    if ( HeadingReference==N2khr_magnetic ) {
-      MCOG=COG;
-      if ( !N2kIsNA(Variation) ) COG = WrapAngle(MCOG + Variation);
-    }
-    if ( NMEA0183SetVTG(NMEA0183Msg,COG,MCOG,SOG) ) {
+  if ( ParseN2kCOGSOGRapid(N2kMsg,SID,HeadingReference,COGSensor,SOG) ) {
+    LastCOGSOGTime=Now();
+    COGSensorMagnetic = (HeadingReference==N2khr_magnetic);
+    InputChanged(dvi_COG | dvi_SOG);
+    SignalKChanged |= skv_COGSOG;
+    if ( !HasNMEA0183Output() || HasDampedOutput() ) return;
+    if ( NMEA0183SetVTG(NMEA0183Msg,GetCOG(),GetMCOG(),SOG) ) {
       SendMessage(NMEA0183Msg);
     }
   }
@@ -324,7 +513,12 @@ double AgeOfCorrection;
   if ( ParseN2kGNSS(N2kMsg,SID,DaysSince1970,SecondsSinceMidnight,Latitude,Longitude,Altitude,GNSStype,GNSSmethod,
                     nSatellites,HDOP,PDOP,GeoidalSeparation,
                     nReferenceStations,ReferenceStationType,ReferenceSationID,AgeOfCorrection) ) {
-    LastPositionTime=millis(); 
+    LastPositionTime=Now(); 
+    SignalKChanged |= skv_Position;
+    if ( DaysSince1970!=N2kUInt16NA && !N2kIsNA(SecondsSinceMidnight) ) {
+      LastGNSSTimeTime=LastPositionTime;
+      if ( GNSSTimeCallback!=0 ) GNSSTimeCallback(DaysSince1970,SecondsSinceMidnight);
+    }
     // RMC will be sent as part of later update, once more data has arrived.
     // But we should send time message immediately.
     tNMEA0183Msg NMEA0183MsgZDA;
@@ -334,6 +528,23 @@ double AgeOfCorrection;
   }
 }
 
+//*****************************************************************************
+// Some GNSS receivers send time only as system time. Use it, if it comes
+// from a real time source and there is no GNSS position time available.
+void tN2kDataToNMEA0183::HandleSystemTime(const tN2kMsg &N2kMsg) {
+  unsigned char SID;
+  uint16_t SystemDate;
+  double SystemTime;
+  tN2kTimeSource TimeSource;
+  if ( GNSSTimeCallback==0 ) return;
+  if ( LastGNSSTimeTime!=0 && Now()-LastGNSSTimeTime<GNSSTimeTimeout ) return;
+  if ( ParseN2kSystemTime(N2kMsg,SID,SystemDate,SystemTime,TimeSource) ) {
+    if ( TimeSource==N2ktimes_LocalCrystalClock ) return;
+    if ( SystemDate==N2kUInt16NA || N2kIsNA(SystemTime) ) return;
+    GNSSTimeCallback(SystemDate,SystemTime);
+  }
+}
+
 //*****************************************************************************
 void tN2kDataToNMEA0183::HandleWind(const tN2kMsg &N2kMsg) {
   unsigned char SID;
@@ -342,17 +553,20 @@ void tN2kDataToNMEA0183::HandleWind(const tN2kMsg &N2kMsg) {
   double WindAngle = N2kDoubleNA;
   if ( ParseN2kWindSpeed(N2kMsg,SID,WindSpeed,WindAngle,WindReference) ) {
     tNMEA0183Msg NMEA0183MsgMWV, NMEA0183MsgMWD;
-    LastWindTime=millis();
+    LastWindTime=Now();
     if ( WindReference==N2kWind_Apparent ) {
       // Only handle apparent wind for now
       WindAngleApp = WindAngle;
       WindSpeedApp = WindSpeed;
+      InputChanged(dvi_WindApparent);
+      SignalKChanged |= skv_WindApparent | skv_WindTrue;
+      if ( !HasNMEA0183Output() || HasDampedOutput() ) return;
       if (NMEA0183SetMWV(NMEA0183MsgMWV,  WindAngleApp*radToDeg, NMEA0183Wind_Apparent, WindSpeedApp)) {
         SendMessage(NMEA0183MsgMWV);
       }
-      CalcTrueWind();
-      if (WindDirTrue != N2kDoubleNA && WindSpeedTrue != N2kDoubleNA) {
-        double WindDirMag_deg = (Variation != N2kDoubleNA) ? WrapAngle(WindDirTrue - Variation)*radToDeg : N2kDoubleNA;
+      if (GetWindDirTrue() != N2kDoubleNA && WindSpeedTrue != N2kDoubleNA) {
+        double _Variation = GetVariation();
+        double WindDirMag_deg = (_Variation != N2kDoubleNA) ? WrapAngle(WindDirTrue - _Variation)*radToDeg : N2kDoubleNA;
         double WindDirTrue_deg = WindDirTrue * radToDeg;
         if (NMEA0183SetMWD(NMEA0183MsgMWD, WindDirTrue_deg, WindDirMag_deg, WindSpeedTrue)) {
           SendMessage(NMEA0183MsgMWD);
@@ -373,6 +587,8 @@ void tN2kDataToNMEA0183::HandleEnvParams(const tN2kMsg &N2kMsg) {
                                       HumiditySource, Humidity, AtmosphericPressure) ) {
     // Check for sea temp data
     if ( TempSource == N2kts_SeaTemperature ) {
+      WaterTemperature = Temperature;
+      SignalKChanged |= skv_WaterTemperature;
       tNMEA0183Msg NMEA0183Msg;
       // Send water temperature
       // From N2k, comes in K. Convert to C.
@@ -383,17 +599,253 @@ void tN2kDataToNMEA0183::HandleEnvParams(const tN2kMsg &N2kMsg) {
   }
 }
 
+//*****************************************************************************
+// AIS messages are re-encoded straight from the raw NMEA2000 fields. Most
+// AIS fields are carried unscaled, so this avoids converting them to
+// doubles and back, and there are lots of these on a busy day.
+static inline uint16_t GetUInt16(const unsigned char *Data) {
+  return Data[0] | (Data[1] << 8);
+}
+
+static inline uint32_t GetUInt32(const unsigned char *Data) {
+  return Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((uint32_t)Data[3] << 24);
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::HandleAISClassAPosition(const tN2kMsg &N2kMsg) {
+  if (N2kMsg.DataLen < 26) return;
+  const unsigned char *Data = N2kMsg.Data;
+  uint8_t MessageID = Data[0] & 0x3f;
+  if (MessageID < 1 || MessageID > 3) MessageID = 1;
+  uint8_t Maneuver = (Data[25] >> 4) & 0x03;
+  tAISBitPacker AISMsg;
+  AISMsg.AddUInt(MessageID, 6);
+  AISMsg.AddUInt(Data[0] >> 6, 2); // Repeat
+  AISMsg.AddUInt(GetUInt32(Data+1), 30); // MMSI
+  AISMsg.AddUInt(Data[25] & 0x0f, 4); // Navigational status
+  AISMsg.AddInt(AISRateOfTurn(GetUInt16(Data+23)), 8);
+  AISMsg.AddUInt(AISSpeed(GetUInt16(Data+16)), 10);
+  AISMsg.AddUInt(Data[13] & 0x01, 1); // Position accuracy
+  AISMsg.AddInt(AISLongitude(GetUInt32(Data+5)), 28);
+  AISMsg.AddInt(AISLatitude(GetUInt32(Data+9)), 27);
+  AISMsg.AddUInt(AISCourse(GetUInt16(Data+14)), 12);
+  AISMsg.AddUInt(AISHeading(GetUInt16(Data+21)), 9);
+  AISMsg.AddUInt(Data[13] >> 2, 6); // Time stamp
+  AISMsg.AddUInt(Maneuver == 3 ? 0 : Maneuver, 2);
+  AISMsg.AddUInt(0, 3); // Spare
+  AISMsg.AddUInt((Data[13] >> 1) & 0x01, 1); // RAIM
+  AISMsg.AddUInt(Data[18] | (Data[19] << 8) | ((Data[20] & 0x07) << 16), 19); // Radio status
+  SendAIS(AISMsg, Data[20] >> 3);
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::HandleAISClassBPosition(const tN2kMsg &N2kMsg) {
+  if (N2kMsg.DataLen < 26) return;
+  const unsigned char *Data = N2kMsg.Data;
+  tAISBitPacker AISMsg;
+  AISMsg.AddUInt(18, 6);
+  AISMsg.AddUInt(Data[0] >> 6, 2); // Repeat
+  AISMsg.AddUInt(GetUInt32(Data+1), 30); // MMSI
+  AISMsg.AddUInt(0, 8); // Reserved
+  AISMsg.AddUInt(AISSpeed(GetUInt16(Data+16)), 10);
+  AISMsg.AddUInt(Data[13] & 0x01, 1); // Position accuracy
+  AISMsg.AddInt(AISLongitude(GetUInt32(Data+5)), 28);
+  AISMsg.AddInt(AISLatitude(GetUInt32(Data+9)), 27);
+  AISMsg.AddUInt(AISCourse(GetUInt16(Data+14)), 12);
+  AISMsg.AddUInt(AISHeading(GetUInt16(Data+21)), 9);
+  AISMsg.AddUInt(Data[13] >> 2, 6); // Time stamp
+  AISMsg.AddUInt(0, 2); // Regional
+  AISMsg.AddUInt((Data[24] >> 2) & 0x01, 1); // CS unit
+  AISMsg.AddUInt((Data[24] >> 3) & 0x01, 1); // Display
+  AISMsg.AddUInt((Data[24] >> 4) & 0x01, 1); // DSC
+  AISMsg.AddUInt((Data[24] >> 5) & 0x01, 1); // Band
+  AISMsg.AddUInt((Data[24] >> 6) & 0x01, 1); // Message 22
+  AISMsg.AddUInt((Data[24] >> 7) & 0x01, 1); // Assigned mode
+  AISMsg.AddUInt((Data[13] >> 1) & 0x01, 1); // RAIM
+  AISMsg.AddUInt(Data[25] & 0x01, 1); // Communication state selector
+  AISMsg.AddUInt(Data[18] | (Data[19] << 8) | ((Data[20] & 0x07) << 16), 19); // Radio status
+  SendAIS(AISMsg, Data[20] >> 3);
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::HandleAISClassAStatic(const tN2kMsg &N2kMsg) {
+  if (N2kMsg.DataLen < 75) return;
+  const unsigned char *Data = N2kMsg.Data;
+  uint32_t IMONumber = GetUInt32(Data+5);
+  uint16_t Length = GetUInt16(Data+37);
+  uint16_t Beam = GetUInt16(Data+39);
+  uint16_t PosRefStbd = GetUInt16(Data+41);
+  uint16_t PosRefBow = GetUInt16(Data+43);
+  uint16_t ETADate = GetUInt16(Data+45);
+  uint32_t ETATime = GetUInt32(Data+47);
+  uint16_t Draught = GetUInt16(Data+51);
+  uint8_t Month = 0, Day = 0, Hour = 24, Minute = 60; // Not available
+  if (ETADate < 0xfffe) {
+    // Days since 1970 to civil date
+    time_t ETA = (time_t)ETADate * 86400;
+    struct tm ETATm;
+    gmtime_r(&ETA, &ETATm);
+    Month = ETATm.tm_mon + 1;
+    Day = ETATm.tm_mday;
+  }
+  if (ETATime < 0xfffffffe) {
+    uint32_t Minutes = ETATime / 600000;
+    Hour = Minutes / 60;
+    Minute = Minutes % 60;
+  }
+  tAISBitPacker AISMsg;
+  AISMsg.AddUInt(5, 6);
+  AISMsg.AddUInt(Data[0] >> 6, 2); // Repeat
+  AISMsg.AddUInt(GetUInt32(Data+1), 30); // MMSI
+  AISMsg.AddUInt(Data[73] & 0x03, 2); // AIS version
+  AISMsg.AddUInt(IMONumber >= 0xfffffffe ? 0 : IMONumber, 30);
+  AISMsg.AddText((const char *)Data+9, 7, 7); // Call sign
+  AISMsg.AddText((const char *)Data+16, 20, 20); // Name
+  AISMsg.AddUInt(Data[36], 8); // Ship type
+  AISMsg.AddUInt(AISDimension(PosRefBow, 511), 9);
+  AISMsg.AddUInt((Length < 0xfffe && PosRefBow < Length) ? AISDimension(Length - PosRefBow, 511) : 0, 9);
+  AISMsg.AddUInt((Beam < 0xfffe && PosRefStbd < Beam) ? AISDimension(Beam - PosRefStbd, 63) : 0, 6);
+  AISMsg.AddUInt(AISDimension(PosRefStbd, 63), 6);
+  AISMsg.AddUInt((Data[73] >> 2) & 0x0f, 4); // EPFD type
+  AISMsg.AddUInt(Month, 4);
+  AISMsg.AddUInt(Day, 5);
+  AISMsg.AddUInt(Hour, 5);
+  AISMsg.AddUInt(Minute, 6);
+  AISMsg.AddUInt(Draught >= 0xfffe ? 0 : (Draught > 2550 ? 255 : Draught / 10), 8);
+  AISMsg.AddText((const char *)Data+53, 20, 20); // Destination
+  AISMsg.AddUInt((Data[73] >> 6) & 0x01, 1); // DTE
+  AISMsg.AddUInt(0, 1); // Spare
+  SendAIS(AISMsg, Data[74] & 0x1f);
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::HandleAISClassBStaticA(const tN2kMsg &N2kMsg) {
+  if (N2kMsg.DataLen < 25) return;
+  const unsigned char *Data = N2kMsg.Data;
+  tAISBitPacker AISMsg;
+  AISMsg.AddUInt(24, 6);
+  AISMsg.AddUInt(Data[0] >> 6, 2); // Repeat
+  AISMsg.AddUInt(GetUInt32(Data+1), 30); // MMSI
+  AISMsg.AddUInt(0, 2); // Part A
+  AISMsg.AddText((const char *)Data+5, 20, 20); // Name
+  AISMsg.AddUInt(0, 8); // Spare
+  SendAIS(AISMsg, N2kMsg.DataLen > 25 ? Data[25] & 0x1f : 0);
+}
+
+//*****************************************************************************
+void tN2kDataToNMEA0183::HandleAISClassBStaticB(const tN2kMsg &N2kMsg) {
+  if (N2kMsg.DataLen < 32) return;
+  const unsigned char *Data = N2kMsg.Data;
+  uint32_t MMSI = GetUInt32(Data+1);
+  uint16_t Length = GetUInt16(Data+20);
+  uint16_t Beam = GetUInt16(Data+22);
+  uint16_t PosRefStbd = GetUInt16(Data+24);
+  uint16_t PosRefBow = GetUInt16(Data+26);
+  tAISBitPacker AISMsg;
+  AISMsg.AddUInt(24, 6);
+  AISMsg.AddUInt(Data[0] >> 6, 2); // Repeat
+  AISMsg.AddUInt(MMSI, 30);
+  AISMsg.AddUInt(1, 2); // Part B
+  AISMsg.AddUInt(Data[5], 8); // Ship type
+  AISMsg.AddText((const char *)Data+6, 7, 7); // Vendor ID
+  AISMsg.AddText((const char *)Data+13, 7, 7); // Call sign
+  if (MMSI / 10000000 == 98) {
+    // Auxiliary craft report mothership instead of dimensions
+    AISMsg.AddUInt(GetUInt32(Data+28), 30);
+  } else {
+    AISMsg.AddUInt(AISDimension(PosRefBow, 511), 9);
+    AISMsg.AddUInt((Length < 0xfffe && PosRefBow < Length) ? AISDimension(Length - PosRefBow, 511) : 0, 9);
+    AISMsg.AddUInt((Beam < 0xfffe && PosRefStbd < Beam) ? AISDimension(Beam - PosRefStbd, 63) : 0, 6);
+    AISMsg.AddUInt(AISDimension(PosRefStbd, 63), 6);
+  }
+  AISMsg.AddUInt(0, 6); // Spare
+  SendAIS(AISMsg, N2kMsg.DataLen > 33 ? Data[33] & 0x1f : 0);
+}
+
+//*****************************************************************************
+// Sends AIS message as one or more !AIVDM sentences. Our own transmissions
+// (as reported by transceiver information) are sent as !AIVDO.
+void tN2kDataToNMEA0183::SendAIS(const tAISBitPacker &AISMsg, uint8_t TransceiverInfo) {
+  char Payload[tAISBitPacker::MaxFragmentChars+1];
+  char SequenceId[2] = { 0, 0 };
+  uint8_t FillBits;
+  uint8_t Fragments = AISMsg.GetFragmentCount();
+  const char *Code = (TransceiverInfo >= 2 && TransceiverInfo <= 4) ? "VDO" : "VDM";
+  const char *Channel = (TransceiverInfo == 0 || TransceiverInfo == 2) ? "A"
+                      : (TransceiverInfo == 1 || TransceiverInfo == 3) ? "B" : "";
+  if (Fragments > 1) {
+    SequenceId[0] = '0' + AISSequenceId;
+    AISSequenceId = (AISSequenceId + 1) % 10;
+  }
+  for (uint8_t i = 0; i < Fragments; i++) {
+    tNMEA0183Msg NMEA0183Msg;
+    if (!AISMsg.GetFragment(i, Payload, FillBits)) break;
+    if (!NMEA0183Msg.Init(Code, "AI", '!')) break;
+    NMEA0183Msg.AddUInt32Field(Fragments);
+    NMEA0183Msg.AddUInt32Field(i+1);
+    NMEA0183Msg.AddStrField(SequenceId);
+    NMEA0183Msg.AddStrField(Channel);
+    NMEA0183Msg.AddStrField(Payload);
+    NMEA0183Msg.AddUInt32Field(FillBits);
+    SendMessage(NMEA0183Msg);
+  }
+}
+
 //*****************************************************************************
 void tN2kDataToNMEA0183::SendRMC() {
-    if ( NextRMCSend<=millis() && !N2kIsNA(Latitude) ) {
+    if ( NextRMCSend<=Now() && !N2kIsNA(Latitude) ) {
       tNMEA0183Msg NMEA0183Msg;
-      if ( NMEA0183SetRMC(NMEA0183Msg,SecondsSinceMidnight,Latitude,Longitude,COG,SOG,DaysSince1970,Variation) ) {
+      if ( NMEA0183SetRMC(NMEA0183Msg,SecondsSinceMidnight,Latitude,Longitude,GetCOG(),SOG,DaysSince1970,GetVariation()) ) {
         SendMessage(NMEA0183Msg);
       }
       SetNextRMCSend();
     }
 }
 
+//*****************************************************************************
+// Sends values changed since last call as one Signal K update
+void tN2kDataToNMEA0183::SendSignalK() {
+  if ( pSignalKOut==0 || SignalKChanged==0 ) return;
+  pSignalKOut->BeginUpdate();
+  if ( SignalKChanged & skv_HeadingMagnetic ) pSignalKOut->AddValue("navigation.headingMagnetic",GetHeadingMagnetic());
+  if ( SignalKChanged & skv_HeadingTrue ) pSignalKOut->AddValue("navigation.headingTrue",GetHeadingTrue());
+  if ( SignalKChanged & skv_Variation ) pSignalKOut->AddValue("navigation.magneticVariation",GetVariation());
+  if ( SignalKChanged & skv_Position ) pSignalKOut->AddPosition(Latitude,Longitude);
+  if ( SignalKChanged & skv_COGSOG ) {
+    pSignalKOut->AddValue("navigation.courseOverGroundTrue",GetCOG());
+    pSignalKOut->AddValue("navigation.speedOverGround",SOG);
+  }
+  if ( SignalKChanged & skv_SpeedThroughWater ) pSignalKOut->AddValue("navigation.speedThroughWater",SpeedThroughWater);
+  if ( SignalKChanged & skv_Depth ) pSignalKOut->AddValue("environment.depth.belowTransducer",DepthBelowTransducer);
+  if ( SignalKChanged & skv_WindApparent ) {
+    // Signal K apparent angle is -pi..pi, positive to starboard
+    double AngleApparent = WindAngleApp;
+    if ( !N2kIsNA(AngleApparent) && AngleApparent>M_PI ) AngleApparent -= 2*M_PI;
+    pSignalKOut->AddValue("environment.wind.angleApparent",AngleApparent);
+    pSignalKOut->AddValue("environment.wind.speedApparent",WindSpeedApp);
+  }
+  if ( SignalKChanged & skv_WindTrue ) {
+    pSignalKOut->AddValue("environment.wind.directionTrue",GetWindDirTrue());
+    pSignalKOut->AddValue("environment.wind.speedTrue",GetWindSpeedTrue());
+  }
+  if ( SignalKChanged & skv_WaterTemperature ) pSignalKOut->AddValue("environment.water.temperature",WaterTemperature);
+  pSignalKOut->EndUpdate();
+  SignalKChanged=0;
+}
+
+//*****************************************************************************
+int64_t tN2kDataToNMEA0183::GetUTCTime_us() {
+  if ( LastGNSSTimeTime!=0 && Now()-LastGNSSTimeTime<GNSSTimeTimeout &&
+       DaysSince1970!=N2kUInt16NA && !N2kIsNA(SecondsSinceMidnight) ) {
+    return (int64_t)DaysSince1970*86400000000LL + llround(SecondsSinceMidnight*1e6)
+           + (int64_t)(Now()-LastGNSSTimeTime)*1000;
+  }
+  if ( UseVirtualTime || !ColumnClockFallback ) return 0;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME,&ts);
+  return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
 //*****************************************************************************
 float tN2kDataToNMEA0183::WrapAngle(float angle) {
   // Wraps any angles going outside [0, 2*pi)
@@ -410,23 +862,26 @@ void tN2kDataToNMEA0183::CalcTrueWind() {
   double vWindTrue_NE[2];
   double vBoatVelocity_NE[2];
   double WindAngleApp_NE;
+  double _HeadingTrue = GetHeadingTrue();
+  double _COG = GetCOG();
   // Need all this data to correctly calculate true wind speed and dir
-  if (HeadingTrue == N2kDoubleNA
+  if (_HeadingTrue == N2kDoubleNA
    || WindAngleApp == N2kDoubleNA
    || WindSpeedApp == N2kDoubleNA
-   || COG == N2kDoubleNA
+   || _COG == N2kDoubleNA
    || SOG == N2kDoubleNA ) {
     WindDirTrue = N2kDoubleNA;
     WindSpeedTrue = N2kDoubleNA;
   } else {
-    WindAngleApp_NE = HeadingTrue + WindAngleApp;
+    WindAngleApp_NE = _HeadingTrue + WindAngleApp;
     vWindApp_NE[0] = WindSpeedApp * cos(WindAngleApp_NE);
     vWindApp_NE[1] = WindSpeedApp * sin(WindAngleApp_NE);
-    vBoatVelocity_NE[0] = SOG * cos(COG);
-    vBoatVelocity_NE[1] = SOG * sin(COG);
+    vBoatVelocity_NE[0] = SOG * cos(_COG);
+    vBoatVelocity_NE[1] = SOG * sin(_COG);
     vWindTrue_NE[0] = vWindApp_NE[0] - vBoatVelocity_NE[0];
     vWindTrue_NE[1] = vWindApp_NE[1] - vBoatVelocity_NE[1];
     WindDirTrue = WrapAngle(atan2(vWindTrue_NE[1], vWindTrue_NE[0]));
-    WindSpeedTrue = sqrt(pow(vWindTrue_NE[0],2) + pow(vWindTrue_NE[1],2));
+    WindSpeedTrue = sqrt(vWindTrue_NE[0]*vWindTrue_NE[0] + vWindTrue_NE[1]*vWindTrue_NE[1]);
   }
+  DerivedDirty &= ~(1<<dv_TrueWind);
 }
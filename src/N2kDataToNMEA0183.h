@@ -23,14 +23,77 @@ OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <NMEA0183.h>
 #include <NMEA2000.h>
+#include "AISEncoder.h"
+#include "SignalKWriter.h"
+#include "N2kCoalescer.h"
+#include "MagneticModel.h"
+#include "LoopMonitor.h"
+#include "RollingStats.h"
+#include "ColumnWriter.h"
+#include "SentencePool.h"
 
 //------------------------------------------------------------------------------
 class tN2kDataToNMEA0183 : public tNMEA2000::tMsgHandler, public tNMEA0183::tMsgHandler {
 public:
   using tSendNMEA0183MessageCallback=void (*)(const tNMEA0183Msg &NMEA0183Msg);
+  // Called with UTC time, as soon as a message carrying GNSS time is handled
+  using tGNSSTimeCallback=void (*)(uint16_t DaysSince1970, double SecondsSinceMidnight);
+  // Columns of time series output, after time. Units are as decoded: degrees
+  // for position, radians, m/s, meters and Kelvin.
+  enum tColumn {
+    col_Latitude,
+    col_Longitude,
+    col_COG,
+    col_SOG,
+    col_HeadingTrue,
+    col_HeadingMagnetic,
+    col_WindAngleApp,
+    col_WindSpeedApp,
+    col_WindDirTrue,
+    col_WindSpeedTrue,
+    col_SpeedThroughWater,
+    col_Depth,
+    col_WaterTemperature,
+    col_Count
+  };
+  static const char * const ColumnNames[col_Count];
     
 protected:
   static const unsigned long RMCPeriod=1000;
+  // System time (126992) is only used for time, if there is no 129029 time
+  static const unsigned long GNSSTimeTimeout=5000;
+  static const size_t MaxSentenceSinks=4;
+  // Values changed since last Signal K update
+  enum tSignalKValue {
+    skv_HeadingMagnetic=1<<0,
+    skv_HeadingTrue=1<<1,
+    skv_Variation=1<<2,
+    skv_Position=1<<3,
+    skv_COGSOG=1<<4,
+    skv_SpeedThroughWater=1<<5,
+    skv_Depth=1<<6,
+    skv_WindApparent=1<<7,
+    skv_WindTrue=1<<8,
+    skv_WaterTemperature=1<<9
+  };
+  // Inputs of derived values
+  enum tDerivedInput {
+    dvi_HeadingMagSensor=1<<0,
+    dvi_HeadingTrueSensor=1<<1,
+    dvi_Deviation=1<<2,
+    dvi_Variation=1<<3,
+    dvi_COG=1<<4,
+    dvi_SOG=1<<5,
+    dvi_WindApparent=1<<6
+  };
+  // Derived values, computed when read after one of their inputs changed
+  enum tDerivedValue {
+    dv_Headings, // HeadingMagnetic, HeadingTrue
+    dv_COG, // COG, MCOG
+    dv_TrueWind, // WindDirTrue, WindSpeedTrue
+    dv_Count
+  };
+  static const uint32_t DerivedInputs[dv_Count];
   double Latitude;
   double Longitude;
   double Altitude;
@@ -40,13 +103,19 @@ protected:
   double HeadingMagnetic;
   double HeadingTrue;
   double HeadingTrueSensor;
+  double COGSensor;
+  bool COGSensorMagnetic;
   double COG;
+  double MCOG;
   double SOG;
   double WindSpeedApp;
   double WindAngleApp;
   double WindSpeedTrue;
   double WindDirTrue;
   double DepthOffset_ft;
+  double SpeedThroughWater;
+  double DepthBelowTransducer;
+  double WaterTemperature;
   unsigned long LastHeadingMagSensorTime;
   unsigned long LastHeadingTrueSensorTime;
   unsigned long LastMagDeviationTime;
@@ -55,15 +124,46 @@ protected:
   unsigned long LastPositionTime;
   unsigned long LastPosSend;
   unsigned long LastWindTime;
+  unsigned long LastGNSSTimeTime;
   uint16_t DaysSince1970;
   double SecondsSinceMidnight;
   unsigned long NextRMCSend;
+  uint8_t AISSequenceId;
+  uint32_t SignalKChanged;
+  uint32_t DerivedDirty;
+  bool UseVirtualTime;
+  unsigned long VirtualTime;
+  bool HeadingTrueControlling;
 
   tNMEA0183 *pNMEA0183Out;
+  tSentencePool *pSentencePool;
+  tSentenceSink *SentenceSinks[MaxSentenceSinks];
+  size_t SentenceSinkCount;
+  tSignalKWriter *pSignalKOut;
+  tN2kCoalescer *pCoalescer;
+  tMagneticModel *pMagneticModel;
+  tLoopMonitor *pLoopMonitor;
+  double ModelVariation;
+  // Damping windows, sampled once per Update()
+  tRollingAngle DampedWindAngleApp;
+  tRollingScalar DampedWindSpeedApp;
+  tRollingAngle DampedWindDirTrue;
+  tRollingScalar DampedWindSpeedTrue;
+  tRollingAngle DampedHeadingTrue;
+  tRollingScalar DampedSOG;
+  unsigned long DampedOutputPeriod;
+  unsigned long NextDampedSend;
+  tColumnWriter *pColumnOut;
+  unsigned long ColumnPeriod;
+  unsigned long NextColumnRow;
+  bool ColumnClockFallback;
 
   tSendNMEA0183MessageCallback SendNMEA0183MessageCallback;
+  tGNSSTimeCallback GNSSTimeCallback;
 
 protected:
+  void ConvertMsg(const tN2kMsg &N2kMsg);
+  void HandleCoalesced();
   // NMEA2000 message handlers
   void HandleHeading(const tN2kMsg &N2kMsg); // 127250
   void HandleVariation(const tN2kMsg &N2kMsg); // 127258
@@ -74,36 +174,82 @@ protected:
   void HandleGNSS(const tN2kMsg &N2kMsg); // 129029
   void HandleWind(const tN2kMsg &N2kMsg); // 130306
   void HandleEnvParams(const tN2kMsg &N2kMsg); // 130311
+  void HandleAISClassAPosition(const tN2kMsg &N2kMsg); // 129038
+  void HandleAISClassBPosition(const tN2kMsg &N2kMsg); // 129039
+  void HandleAISClassAStatic(const tN2kMsg &N2kMsg); // 129794
+  void HandleAISClassBStaticA(const tN2kMsg &N2kMsg); // 129809
+  void HandleAISClassBStaticB(const tN2kMsg &N2kMsg); // 129810
+  void HandleSystemTime(const tN2kMsg &N2kMsg); // 126992
   // NMEA0183 message handlers (for aux input)
   void HandleHeadingNMEA0183(const tNMEA0183Msg &NMEA0183Msg); // HDG
   // Message senders
-  void SetNextRMCSend() { NextRMCSend=millis()+RMCPeriod; }
+  // RMC is sent on whole seconds, so output does not depend on start time
+  void SetNextRMCSend() { NextRMCSend=(Now()/RMCPeriod+1)*RMCPeriod; }
   void SendRMC();
   void SendMessage(const tNMEA0183Msg &NMEA0183Msg);
+  void SendAIS(const tAISBitPacker &AISMsg, uint8_t TransceiverInfo);
+  void SendSignalK();
+  void UpdateModelVariation();
+  void UpdateDamping();
+  void SendDamped();
+  void WriteColumns();
+
+  // Derived values
+  void InputChanged(uint32_t Inputs);
+  bool IsDirty(tDerivedValue Value) const { return (DerivedDirty & (1<<Value))!=0; }
+  void CalcHeadings();
+  void CalcCOG();
+  void CalcTrueWind();
+  bool HasNMEA0183Output() const { return pNMEA0183Out!=0 || SendNMEA0183MessageCallback!=0 || SentenceSinkCount>0; }
+  // Damped MWV, MWD, HDT and VTG are sent at fixed rate instead of per message
+  bool HasDampedOutput() const { return DampedOutputPeriod>0; }
 
   // Utilities
-  void UpdateHeadingsNewMagnetic();
-  void UpdateHeadingsNewTrue();
+  unsigned long Now() const { return UseVirtualTime ? VirtualTime : millis(); }
   float WrapAngle(float angle);
-  void CalcTrueWind();
+  // UTC (us since 1970) from last GNSS time, or from system clock when
+  // fallback is enabled. 0 if not known.
+  int64_t GetUTCTime_us();
   
 public:
   tN2kDataToNMEA0183(tNMEA2000 *_pNMEA2000, tNMEA0183 *_pNMEA0183AuxIn, tNMEA0183 *_pNMEA0183Out)
     : tNMEA2000::tMsgHandler(0,_pNMEA2000), 
       tNMEA0183::tMsgHandler(_pNMEA0183AuxIn) {
     SendNMEA0183MessageCallback=0;
+    GNSSTimeCallback=0;
     pNMEA0183Out=_pNMEA0183Out;
+    pSentencePool=0;
+    SentenceSinkCount=0;
     Latitude=N2kDoubleNA; Longitude=N2kDoubleNA; Altitude=N2kDoubleNA;
     Variation=N2kDoubleNA; Deviation=N2kDoubleNA; 
     HeadingMagSensor=N2kDoubleNA; HeadingMagnetic=N2kDoubleNA;
     HeadingTrueSensor=N2kDoubleNA; HeadingTrue=N2kDoubleNA;
     WindAngleApp=N2kDoubleNA; WindSpeedApp=N2kDoubleNA;
     WindDirTrue=N2kDoubleNA; WindSpeedTrue=N2kDoubleNA;
-    COG=N2kDoubleNA; SOG=N2kDoubleNA;
+    COGSensor=N2kDoubleNA; COGSensorMagnetic=false;
+    COG=N2kDoubleNA; MCOG=N2kDoubleNA; SOG=N2kDoubleNA;
+    DerivedDirty=(1<<dv_Count)-1;
+    HeadingTrueControlling=false;
     SecondsSinceMidnight=N2kDoubleNA; DaysSince1970=N2kUInt16NA;
     DepthOffset_ft=N2kDoubleNA;
+    SpeedThroughWater=N2kDoubleNA; DepthBelowTransducer=N2kDoubleNA; WaterTemperature=N2kDoubleNA;
+    pSignalKOut=0;
+    pCoalescer=0;
+    pMagneticModel=0;
+    pLoopMonitor=0;
+    ModelVariation=N2kDoubleNA;
+    DampedOutputPeriod=0;
+    NextDampedSend=0;
+    pColumnOut=0;
+    ColumnPeriod=1000;
+    NextColumnRow=0;
+    ColumnClockFallback=false;
+    SignalKChanged=0;
     LastPosSend=0;
+    UseVirtualTime=false;
+    VirtualTime=0;
     NextRMCSend=millis()+RMCPeriod;
+    AISSequenceId=0;
     LastHeadingMagSensorTime=0;
     LastHeadingTrueSensorTime=0;
     LastMagDeviationTime=0;
@@ -111,15 +257,85 @@ public:
     LastCOGSOGTime=0;
     LastPositionTime=0;
     LastWindTime=0;
+    LastGNSSTimeTime=0;
   }
   void HandleMsg(const tN2kMsg &N2kMsg);
   void HandleMsg(const tNMEA0183Msg &NMEA0183Msg);
   void SetSendNMEA0183MessageCallback(tSendNMEA0183MessageCallback _SendNMEA0183MessageCallback) {
     SendNMEA0183MessageCallback=_SendNMEA0183MessageCallback;
   }
+  void SetGNSSTimeCallback(tGNSSTimeCallback _GNSSTimeCallback) {
+    GNSSTimeCallback=_GNSSTimeCallback;
+  }
+  // Sentences are formatted once into a buffer from Pool, which every sink
+  // added gets. Returns false, if there are too many sinks.
+  bool AddSentenceSink(tSentencePool *Pool, tSentenceSink *pSink) {
+    if (SentenceSinkCount>=MaxSentenceSinks) return false;
+    pSentencePool=Pool;
+    SentenceSinks[SentenceSinkCount++]=pSink;
+    return true;
+  }
+  // Values are also sent as Signal K deltas, batched once per Update()
+  void SetSignalKOutput(tSignalKWriter *_pSignalKOut) {
+    pSignalKOut=_pSignalKOut;
+  }
+  // Messages of PGNs coalesced are handled in Update(), newest only
+  void SetCoalescer(tN2kCoalescer *_pCoalescer) {
+    pCoalescer=_pCoalescer;
+  }
+  // Variation from model is used, when there is none from the bus
+  void SetMagneticModel(tMagneticModel *_pMagneticModel) {
+    pMagneticModel=_pMagneticModel;
+  }
+  // Each handled message is a checkpoint for loop deadline monitoring
+  void SetLoopMonitor(tLoopMonitor *_pLoopMonitor) {
+    pLoopMonitor=_pLoopMonitor;
+  }
+  // Decoded values are written as a row of time series every Period ms.
+  // Output can be detached with NULL, rows stay on the same time grid.
+  // Without recent GNSS time rows are skipped, or with ClockFallback (live
+  // input only) stamped with the system clock.
+  void SetColumnOutput(tColumnWriter *_pColumnOut, unsigned long Period, bool ClockFallback=false) {
+    pColumnOut=_pColumnOut;
+    if (Period>0) ColumnPeriod=Period;
+    ColumnClockFallback=ClockFallback;
+  }
+  void SetDamping(const tDampingOptions &Options) {
+    DampedWindAngleApp.SetPeriod(Options.Wind_s*1000);
+    DampedWindSpeedApp.SetPeriod(Options.Wind_s*1000);
+    DampedWindDirTrue.SetPeriod(Options.Wind_s*1000);
+    DampedWindSpeedTrue.SetPeriod(Options.Wind_s*1000);
+    DampedHeadingTrue.SetPeriod(Options.Heading_s*1000);
+    DampedSOG.SetPeriod(Options.Speed_s*1000);
+    DampedOutputPeriod=Options.OutputPeriod_s*1000;
+  }
+  // For offline conversion. Time (ms) is set by the caller from capture
+  // time stamps instead of being read from the clock.
+  void SetTime(unsigned long Time) {
+    bool First=!UseVirtualTime;
+    UseVirtualTime=true;
+    VirtualTime=Time;
+    if (First) SetNextRMCSend();
+  }
   void SetDepthOffset(double depth_offset_ft) {
     DepthOffset_ft = depth_offset_ft;
   }
   void Update();
+
+  // Derived values
+  double GetVariation() const { return !N2kIsNA(Variation) ? Variation : ModelVariation; }
+  double GetHeadingMagnetic() { if (IsDirty(dv_Headings)) CalcHeadings(); return HeadingMagnetic; }
+  double GetHeadingTrue() { if (IsDirty(dv_Headings)) CalcHeadings(); return HeadingTrue; }
+  double GetCOG() { if (IsDirty(dv_COG)) CalcCOG(); return COG; }
+  double GetMCOG() { if (IsDirty(dv_COG)) CalcCOG(); return MCOG; }
+  double GetWindDirTrue() { if (IsDirty(dv_TrueWind)) CalcTrueWind(); return WindDirTrue; }
+  double GetWindSpeedTrue() { if (IsDirty(dv_TrueWind)) CalcTrueWind(); return WindSpeedTrue; }
+  // Damping windows, for statistics
+  const tRollingAngle& GetDampedWindAngleApp() const { return DampedWindAngleApp; }
+  const tRollingScalar& GetDampedWindSpeedApp() const { return DampedWindSpeedApp; }
+  const tRollingAngle& GetDampedWindDirTrue() const { return DampedWindDirTrue; }
+  const tRollingScalar& GetDampedWindSpeedTrue() const { return DampedWindSpeedTrue; }
+  const tRollingAngle& GetDampedHeadingTrue() const { return DampedHeadingTrue; }
+  const tRollingScalar& GetDampedSOG() const { return DampedSOG; }
 };
 
@@ -0,0 +1,495 @@
+/*
+n2kloadgen
+Synthetic NMEA2000 load generator for SocketCAN (usually vcan).
+
+Writes synthetic frames with a configurable PGN mix, or frames replayed
+from a candump capture, to a CAN interface at a fixed frame rate. Fast
+packet PGNs (GNSS, AIS) are split into frames like a real device does,
+and AIS bursts can be added on top of the base rate.
+
+With --measure it also reads the NMEA0183 output of n2kconvert and reports
+sentence rate and conversion latency. Latency is measured on heading
+(127250): every heading sent carries a sequence number in its value, which
+is recovered from the HDG sentence.
+*/
+
+#include <boost/program_options.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "LatencyHistogram.h"
+#include "NMEA2000_CandumpReplay.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+// Heading sequence numbers wrap at 3600 (0.1 degree steps)
+static const int HeadingSequences = 3600;
+static const double MetersPerSecToKnots = 3600.0 / 1852.0;
+
+static atomic<bool> run_program(true);
+
+//------------------------------------------------------------------------------
+struct tMixEntry {
+  unsigned long PGN;
+  int Weight;
+  int Current;
+  unsigned char FastPacketSequence;
+};
+
+//------------------------------------------------------------------------------
+// Shared between sender and output reader
+struct tMeasurement {
+  mutex Lock;
+  chrono::steady_clock::time_point HeadingSendTime[HeadingSequences];
+  bool HeadingSent[HeadingSequences];
+  tLatencyHistogram Latency;
+  tLatencyHistogram PeriodLatency;
+  atomic<uint64_t> Sentences;
+  tMeasurement() : Sentences(0) {
+    memset(HeadingSent, 0, sizeof(HeadingSent));
+  }
+};
+
+//------------------------------------------------------------------------------
+class tCANWriter {
+protected:
+  int fd;
+  unsigned char Source;
+public:
+  uint64_t FramesSent;
+  uint64_t SendErrors;
+
+  tCANWriter(unsigned char _Source) : fd(-1), Source(_Source), FramesSent(0), SendErrors(0) {}
+  ~tCANWriter() { if (fd >= 0) close(fd); }
+
+  bool Open(const char *Interface) {
+    fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) return false;
+    // We only write
+    setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, Interface, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) return false;
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    return bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  }
+
+  bool SendFrame(unsigned long Id, unsigned char Len, const unsigned char *Data) {
+    struct can_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = (Id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+    frame.can_dlc = Len;
+    memcpy(frame.data, Data, Len);
+    // Transmit queue full (ENOBUFS) is retried for a while, then counted
+    for (int retry = 0; retry < 100; retry++) {
+      if (write(fd, &frame, sizeof(frame)) == sizeof(frame)) {
+        FramesSent++;
+        return true;
+      }
+      if (errno != ENOBUFS && errno != EAGAIN) break;
+      usleep(100);
+    }
+    SendErrors++;
+    return false;
+  }
+
+  unsigned long CANId(unsigned long PGN, unsigned char Priority) {
+    return ((unsigned long)(Priority & 0x07) << 26) | (PGN << 8) | Source;
+  }
+
+  // Sends message as single frame or as fast packet. Returns frames sent.
+  int SendMessage(unsigned long PGN, unsigned char Priority, const unsigned char *Data, int Len,
+                  unsigned char &FastPacketSequence) {
+    unsigned long Id = CANId(PGN, Priority);
+    unsigned char Frame[8];
+    if (Len <= 8) {
+      memset(Frame, 0xff, 8);
+      memcpy(Frame, Data, Len);
+      SendFrame(Id, 8, Frame);
+      return 1;
+    }
+    unsigned char Sequence = (FastPacketSequence++ & 0x07) << 5;
+    int Frames = 0;
+    int Index = 0;
+    for (unsigned char FrameNo = 0; Index < Len; FrameNo++) {
+      memset(Frame, 0xff, 8);
+      Frame[0] = Sequence | FrameNo;
+      int Start = 1;
+      if (FrameNo == 0) {
+        Frame[1] = Len;
+        Start = 2;
+      }
+      for (int i = Start; i < 8 && Index < Len; i++) Frame[i] = Data[Index++];
+      SendFrame(Id, 8, Frame);
+      Frames++;
+    }
+    return Frames;
+  }
+};
+
+//------------------------------------------------------------------------------
+// Little endian field helpers
+static int Put1(unsigned char *p, int i, uint8_t v) { p[i] = v; return i + 1; }
+static int Put2(unsigned char *p, int i, uint16_t v) { p[i] = v; p[i+1] = v >> 8; return i + 2; }
+static int Put4(unsigned char *p, int i, uint32_t v) { for (int b = 0; b < 4; b++) p[i+b] = v >> (8*b); return i + 4; }
+static int Put8(unsigned char *p, int i, uint64_t v) { for (int b = 0; b < 8; b++) p[i+b] = v >> (8*b); return i + 8; }
+static int PutStr(unsigned char *p, int i, const char *s, int Len) {
+  for (int b = 0; b < Len; b++) p[i+b] = (*s) ? *s++ : '@';
+  return i + Len;
+}
+
+//------------------------------------------------------------------------------
+// Builds synthetic payload for PGN. Values drift slowly with Counter, so the
+// converter sees changing data. Returns payload length, 0 for unknown PGN.
+static int BuildPayload(unsigned long PGN, uint32_t Counter, int AISTargets, int HeadingSequence, unsigned char *p) {
+  double t = Counter * 0.01;
+  int i = 0;
+  switch (PGN) {
+    case 127250: // Heading, sequence number in value
+      i = Put1(p, i, Counter);
+      i = Put2(p, i, lround(HeadingSequence / 10.0 * M_PI / 180.0 * 1e4));
+      i = Put2(p, i, 0x7fff); // Deviation
+      i = Put2(p, i, 0x7fff); // Variation
+      i = Put1(p, i, 0xfc | 1); // Magnetic
+      break;
+    case 128267: // Depth
+      i = Put1(p, i, Counter);
+      i = Put4(p, i, lround((10.0 + 2.0 * sin(t)) * 100));
+      i = Put2(p, i, 500);
+      i = Put1(p, i, 10);
+      break;
+    case 129025: // Position rapid
+      i = Put4(p, i, (uint32_t)lround((60.15 + 0.001 * sin(t)) * 1e7));
+      i = Put4(p, i, (uint32_t)lround((24.95 + 0.001 * cos(t)) * 1e7));
+      break;
+    case 129026: // COG & SOG rapid
+      i = Put1(p, i, Counter);
+      i = Put1(p, i, 0xfc);
+      i = Put2(p, i, lround(fmod(1.0 + 0.1 * sin(t), 2 * M_PI) * 1e4));
+      i = Put2(p, i, lround((3.0 + 0.5 * sin(t)) * 100));
+      i = Put2(p, i, 0xffff);
+      break;
+    case 129029: { // GNSS
+      time_t now = time(0);
+      i = Put1(p, i, Counter);
+      i = Put2(p, i, now / 86400);
+      i = Put4(p, i, (now % 86400) * 10000);
+      i = Put8(p, i, (uint64_t)(int64_t)llround(60.15 * 1e16));
+      i = Put8(p, i, (uint64_t)(int64_t)llround(24.95 * 1e16));
+      i = Put8(p, i, (uint64_t)(int64_t)llround(10.0 * 1e6));
+      i = Put1(p, i, 0x10); // GPS, GNSS fix
+      i = Put1(p, i, 0xfc);
+      i = Put1(p, i, 9);
+      i = Put2(p, i, 90);
+      i = Put2(p, i, 150);
+      i = Put4(p, i, 1800);
+      i = Put1(p, i, 0);
+      break;
+    }
+    case 129038: // AIS class A position
+    case 129039: { // AIS class B position
+      uint32_t MMSI = 230000000 + Counter % AISTargets;
+      i = Put1(p, i, PGN == 129038 ? 1 : 18);
+      i = Put4(p, i, MMSI);
+      i = Put4(p, i, (uint32_t)lround((24.9 + 0.0001 * (MMSI % 1000)) * 1e7));
+      i = Put4(p, i, (uint32_t)lround((60.1 + 0.0001 * (MMSI % 997)) * 1e7));
+      i = Put1(p, i, (Counter % 60) << 2);
+      i = Put2(p, i, lround(fmod(0.01 * MMSI, 2 * M_PI) * 1e4));
+      i = Put2(p, i, MMSI % 800);
+      i = Put1(p, i, 0); i = Put1(p, i, 0); i = Put1(p, i, 0); // Communication state, transceiver
+      i = Put2(p, i, lround(fmod(0.01 * MMSI, 2 * M_PI) * 1e4));
+      if (PGN == 129038) {
+        i = Put2(p, i, 0);
+        i = Put1(p, i, 0xf0);
+        i = Put1(p, i, 0xff);
+      } else {
+        i = Put1(p, i, 0xff);
+        i = Put1(p, i, 0x04 | 0x40);
+        i = Put1(p, i, 0xfe);
+      }
+      break;
+    }
+    case 129794: { // AIS class A static
+      uint32_t MMSI = 230000000 + Counter % AISTargets;
+      i = Put1(p, i, 5);
+      i = Put4(p, i, MMSI);
+      i = Put4(p, i, 9000000 + MMSI % 1000000);
+      i = PutStr(p, i, "OH1234", 7);
+      i = PutStr(p, i, "LOADGEN VESSEL", 20);
+      i = Put1(p, i, 70);
+      i = Put2(p, i, 1200);
+      i = Put2(p, i, 200);
+      i = Put2(p, i, 100);
+      i = Put2(p, i, 300);
+      i = Put2(p, i, 19000);
+      i = Put4(p, i, 12 * 3600 * 10000);
+      i = Put2(p, i, 550);
+      i = PutStr(p, i, "HELSINKI", 20);
+      i = Put1(p, i, 0x04);
+      i = Put1(p, i, 0xe0);
+      break;
+    }
+    case 130306: // Wind, apparent
+      i = Put1(p, i, Counter);
+      i = Put2(p, i, lround((6.0 + 2.0 * sin(t)) * 100));
+      i = Put2(p, i, lround(fmod(0.8 + 0.2 * sin(t), 2 * M_PI) * 1e4));
+      i = Put1(p, i, 0xf8 | 2);
+      break;
+  }
+  return i;
+}
+
+//------------------------------------------------------------------------------
+// "127250:20,130306:10" -> mix entries
+static bool ParseMix(const string &Mix, vector<tMixEntry> &Entries) {
+  const char *p = Mix.c_str();
+  while (*p) {
+    char *end;
+    tMixEntry Entry;
+    Entry.PGN = strtoul(p, &end, 10);
+    if (end == p || *end != ':') return false;
+    p = end + 1;
+    Entry.Weight = strtol(p, &end, 10);
+    if (end == p || Entry.Weight <= 0) return false;
+    p = end;
+    if (*p == ',') p++;
+    unsigned char Dummy[256];
+    if (BuildPayload(Entry.PGN, 0, 1, 0, Dummy) == 0) {
+      cerr << "Unsupported PGN in mix: " << Entry.PGN << "\n";
+      return false;
+    }
+    Entry.Current = 0;
+    Entry.FastPacketSequence = 0;
+    Entries.push_back(Entry);
+  }
+  return !Entries.empty();
+}
+
+//------------------------------------------------------------------------------
+// Smooth weighted round robin, gives evenly spread PGNs with exact ratios
+static tMixEntry& NextMixEntry(vector<tMixEntry> &Entries) {
+  int Total = 0;
+  tMixEntry *Best = &Entries[0];
+  for (size_t i = 0; i < Entries.size(); i++) {
+    Entries[i].Current += Entries[i].Weight;
+    Total += Entries[i].Weight;
+    if (Entries[i].Current > Best->Current) Best = &Entries[i];
+  }
+  Best->Current -= Total;
+  return *Best;
+}
+
+//------------------------------------------------------------------------------
+// Reads n2kconvert output, counts sentences and measures heading latency
+static void ReadOutput(string Path, tMeasurement *Measurement) {
+  int fd = open(Path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    cerr << "Cannot open output to measure: " << Path << "\n";
+    return;
+  }
+  char Buf[4096];
+  char Line[256];
+  size_t LineLen = 0;
+  while (run_program) {
+    ssize_t res = read(fd, Buf, sizeof(Buf));
+    if (res <= 0) break;
+    auto now = chrono::steady_clock::now();
+    for (ssize_t i = 0; i < res; i++) {
+      if (Buf[i] != '\n') {
+        if (LineLen < sizeof(Line) - 1) Line[LineLen++] = Buf[i];
+        continue;
+      }
+      Line[LineLen] = 0;
+      LineLen = 0;
+      Measurement->Sentences++;
+      const char *Hdg = strstr(Line, "HDG,");
+      if (Hdg == 0) continue;
+      int Sequence = (int)lround(atof(Hdg + 4) * 10) % HeadingSequences;
+      lock_guard<mutex> guard(Measurement->Lock);
+      if (!Measurement->HeadingSent[Sequence]) continue;
+      Measurement->HeadingSent[Sequence] = false;
+      auto Latency = chrono::duration_cast<chrono::microseconds>(now - Measurement->HeadingSendTime[Sequence]).count();
+      Measurement->Latency.Add(Latency);
+      Measurement->PeriodLatency.Add(Latency);
+    }
+  }
+  close(fd);
+}
+
+//------------------------------------------------------------------------------
+static void PrintLatency(const char *Title, const tLatencyHistogram &Latency) {
+  cout << Title << " latency over " << Latency.GetCount() << " headings: "
+    << "p50 " << Latency.GetPercentile(50) / 1000.0 << "ms; "
+    << "p90 " << Latency.GetPercentile(90) / 1000.0 << "ms; "
+    << "p99 " << Latency.GetPercentile(99) / 1000.0 << "ms; "
+    << "max " << Latency.GetMax() / 1000.0 << "ms\n";
+}
+
+//------------------------------------------------------------------------------
+void HandleSignal(int) {
+  run_program = false;
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char* argv[]) {
+  string interface, mix, replay_file, measure_path;
+  double rate, duration;
+  int source, ais_targets, ais_burst, burst_period;
+  po::options_description options("n2kloadgen options");
+  options.add_options()
+    ("help", "produce help message")
+    ("interface,i", po::value<string>(&interface)->default_value("vcan0"), "CAN interface to write to")
+    ("rate,r", po::value<double>(&rate)->default_value(1800), "frames per second")
+    ("duration,t", po::value<double>(&duration)->default_value(10), "test duration (s)")
+    ("mix,m", po::value<string>(&mix)->default_value("127250:10,130306:10,129025:10,129026:10,128267:1,129029:1,129038:20,129039:5,129794:1"),
+      "PGN mix as PGN:relative message rate list")
+    ("source,s", po::value<int>(&source)->default_value(0x23), "source address")
+    ("aistargets", po::value<int>(&ais_targets)->default_value(300), "number of distinct AIS targets")
+    ("aisburst", po::value<int>(&ais_burst)->default_value(0), "AIS position reports per burst, on top of rate")
+    ("burstperiod", po::value<int>(&burst_period)->default_value(2), "AIS burst period (s)")
+    ("replay", po::value<string>(&replay_file), "replay frames from candump capture (looped) instead of mix")
+    ("measure", po::value<string>(&measure_path), "n2kconvert output file/FIFO to measure sentences and latency from")
+  ;
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, options), vm);
+  po::notify(vm);
+  if (vm.count("help")) {
+    cout << options << "\n";
+    return 0;
+  }
+  vector<tMixEntry> Mix;
+  if (replay_file.empty() && !ParseMix(mix, Mix)) {
+    cerr << "Invalid PGN mix: " << mix << "\n";
+    return 3;
+  }
+  if (rate <= 0 || ais_targets <= 0 || burst_period <= 0) {
+    cerr << "Rate, AIS targets and burst period must be positive.\n";
+    return 3;
+  }
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+
+  tCANWriter Writer(source);
+  if (!Writer.Open(interface.c_str())) {
+    cerr << "Cannot open CAN interface " << interface << ": " << strerror(errno) << "\n";
+    return 3;
+  }
+  tNMEA2000_CandumpReplay *pReplay = NULL;
+  if (!replay_file.empty()) {
+    pReplay = new tNMEA2000_CandumpReplay(replay_file.c_str());
+    if (!pReplay->CANOpen()) return 3;
+    pReplay->ReleaseAll();
+  }
+  tMeasurement *pMeasurement = new tMeasurement;
+  thread Reader;
+  if (!measure_path.empty()) {
+    Reader = thread(ReadOutput, measure_path, pMeasurement);
+  }
+
+  cout << "Sending " << rate << " frames/s to " << interface << " for " << duration << "s.\n";
+  unsigned char Payload[256];
+  unsigned char BurstSequence = 0;
+  uint32_t Counter = 0;
+  int HeadingSequence = 0;
+  uint64_t Frames = 0;
+  uint64_t LastFrames = 0, LastSendErrors = 0, LastSentences = 0;
+  auto start = chrono::steady_clock::now();
+  auto end = start + chrono::microseconds((int64_t)(duration * 1e6));
+  auto next_tick = start;
+  auto next_report = start + chrono::seconds(1);
+  auto next_burst = start + chrono::seconds(burst_period);
+  while (run_program && next_tick < end) {
+    // Send everything due by this 1 ms tick
+    next_tick += chrono::milliseconds(1);
+    this_thread::sleep_until(next_tick);
+    double elapsed = chrono::duration<double>(next_tick - start).count();
+    while ((double)Frames < elapsed * rate) {
+      if (pReplay) {
+        unsigned long id;
+        unsigned char len, buf[8];
+        if (!pReplay->CANGetFrame(id, len, buf)) {
+          // Start over
+          delete pReplay;
+          pReplay = new tNMEA2000_CandumpReplay(replay_file.c_str());
+          pReplay->CANOpen();
+          pReplay->ReleaseAll();
+          if (!pReplay->CANGetFrame(id, len, buf)) break;
+        }
+        Writer.SendFrame(id, len, buf);
+        Frames++;
+        continue;
+      }
+      tMixEntry &Entry = NextMixEntry(Mix);
+      int Len = BuildPayload(Entry.PGN, Counter++, ais_targets, HeadingSequence, Payload);
+      if (Entry.PGN == 127250) {
+        lock_guard<mutex> guard(pMeasurement->Lock);
+        pMeasurement->HeadingSendTime[HeadingSequence] = chrono::steady_clock::now();
+        pMeasurement->HeadingSent[HeadingSequence] = true;
+        HeadingSequence = (HeadingSequence + 1) % HeadingSequences;
+      }
+      Frames += Writer.SendMessage(Entry.PGN, 2, Payload, Len, Entry.FastPacketSequence);
+    }
+    // AIS burst on top of base rate, as when a slot fills with reports
+    if (ais_burst > 0 && next_tick >= next_burst) {
+      for (int i = 0; i < ais_burst; i++) {
+        int Len = BuildPayload(129038, Counter++, ais_targets, 0, Payload);
+        Writer.SendMessage(129038, 4, Payload, Len, BurstSequence);
+      }
+      next_burst += chrono::seconds(burst_period);
+    }
+    if (next_tick >= next_report) {
+      uint64_t Sentences = pMeasurement->Sentences;
+      cout << "Frames/s: " << Writer.FramesSent - LastFrames
+        << "; send errors: " << Writer.SendErrors - LastSendErrors;
+      if (!measure_path.empty()) {
+        cout << "; sentences/s: " << Sentences - LastSentences << "; ";
+        lock_guard<mutex> guard(pMeasurement->Lock);
+        PrintLatency("heading", pMeasurement->PeriodLatency);
+        pMeasurement->PeriodLatency.Reset();
+      } else {
+        cout << "\n";
+      }
+      LastFrames = Writer.FramesSent;
+      LastSendErrors = Writer.SendErrors;
+      LastSentences = Sentences;
+      next_report += chrono::seconds(1);
+    }
+  }
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  // Let the last sentences through before summary
+  this_thread::sleep_for(chrono::milliseconds(500));
+  run_program = false;
+  cout << "Summary: " << Writer.FramesSent << " frames in " << elapsed << "s ("
+    << Writer.FramesSent / elapsed << " frames/s), send errors " << Writer.SendErrors << "\n";
+  if (!measure_path.empty()) {
+    cout << "Summary: " << pMeasurement->Sentences << " sentences ("
+      << pMeasurement->Sentences / elapsed << " sentences/s)\n";
+    lock_guard<mutex> guard(pMeasurement->Lock);
+    PrintLatency("Summary: heading", pMeasurement->Latency);
+  }
+  // Reader may be blocked in read() on a quiet FIFO, so it is not joined
+  if (Reader.joinable()) Reader.detach();
+  delete pReplay;
+  return 0;
+}
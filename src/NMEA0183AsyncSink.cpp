@@ -0,0 +1,317 @@
+/*
+NMEA0183AsyncSink.cpp
+
+Asynchronous output sink for NMEA0183 sentences. See header for details.
+*/
+
+#include "NMEA0183AsyncSink.h"
+#include <chrono>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t tNMEA0183AsyncSink::MaxRecordLen;
+const int tNMEA0183AsyncSink::ReconnectPeriod_ms;
+const int tNMEA0183AsyncSink::PollTimeout_ms;
+const int tNMEA0183AsyncSink::MaxIov;
+
+//*****************************************************************************
+tNMEA0183AsyncSink::tNMEA0183AsyncSink(const char *_Path, size_t _BufSize)
+  : Path(_Path), Buf(0), BufSize(_BufSize), ReadPos(0), Used(0), UsedRecords(0),
+    RecordLen(0), RecordOverflow(false), Sentences(0), SentenceQueueSize(0), SentenceReadPos(0),
+    SentenceCount(0), SentenceOffset(0), fd(-1), EverConnected(false), LastOpenError(0), Running(false),
+    BytesWritten(0), SentencesWritten(0), SentencesDropped(0), BlockedTime_us(0),
+    Reconnects(0), Connected(false) {
+  if (BufSize < MaxRecordLen) BufSize = MaxRecordLen;
+  SentenceQueueSize = GetSentenceCapacity(BufSize);
+}
+
+//*****************************************************************************
+// Queued sentences take at most BufSize bytes, like queued records
+size_t tNMEA0183AsyncSink::GetSentenceCapacity(size_t BufSize) {
+  if (BufSize < MaxRecordLen) BufSize = MaxRecordLen;
+  return BufSize / tSentence::MaxLen;
+}
+
+//*****************************************************************************
+tNMEA0183AsyncSink::~tNMEA0183AsyncSink() {
+  Close();
+  delete[] Buf;
+  delete[] Sentences;
+}
+
+//*****************************************************************************
+bool tNMEA0183AsyncSink::Open() {
+  if (Running) return true;
+  if (Buf == 0) Buf = new char[BufSize];
+  if (Sentences == 0) Sentences = new tSentence*[SentenceQueueSize];
+  Running = true;
+  Writer = thread(&tNMEA0183AsyncSink::WriterLoop, this);
+  return true;
+}
+
+//*****************************************************************************
+void tNMEA0183AsyncSink::Close() {
+  {
+    lock_guard<mutex> guard(Lock);
+    if (!Running) return;
+    Running = false;
+  }
+  DataReady.notify_all();
+  if (Writer.joinable()) Writer.join();
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  ReleaseSentences();
+  Connected = false;
+}
+
+//*****************************************************************************
+void tNMEA0183AsyncSink::GetStats(tStats &Stats) const {
+  Stats.BytesWritten = BytesWritten;
+  Stats.SentencesWritten = SentencesWritten;
+  Stats.SentencesDropped = SentencesDropped;
+  Stats.BlockedTime_us = BlockedTime_us;
+  Stats.Reconnects = Reconnects;
+  Stats.Connected = Connected;
+}
+
+//*****************************************************************************
+// Called from the conversion thread. Data is collected until end of line
+// and then queued as one record, so the reader never sees partial sentences.
+size_t tNMEA0183AsyncSink::write(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (RecordLen < MaxRecordLen) {
+      Record[RecordLen++] = data[i];
+    } else {
+      RecordOverflow = true;
+    }
+    if (data[i] == '\n') {
+      CommitRecord();
+    }
+  }
+  return size;
+}
+
+//*****************************************************************************
+void tNMEA0183AsyncSink::CommitRecord() {
+  bool Queued = false;
+  if (!RecordOverflow && Buf != 0) {
+    lock_guard<mutex> guard(Lock);
+    // While nobody reads the output, there is no point in queuing
+    if (fd >= 0 && BufSize - Used >= RecordLen) {
+      size_t WritePos = (ReadPos + Used) % BufSize;
+      size_t First = BufSize - WritePos;
+      if (First > RecordLen) First = RecordLen;
+      memcpy(Buf + WritePos, Record, First);
+      memcpy(Buf, Record + First, RecordLen - First);
+      Used += RecordLen;
+      UsedRecords++;
+      Queued = true;
+    }
+  }
+  if (Queued) {
+    DataReady.notify_one();
+  } else {
+    SentencesDropped++;
+  }
+  RecordLen = 0;
+  RecordOverflow = false;
+}
+
+//*****************************************************************************
+// Called from the conversion thread. Only the reference is queued.
+void tNMEA0183AsyncSink::SendSentence(tSentence *pSentence) {
+  bool Queued = false;
+  if (Sentences != 0) {
+    lock_guard<mutex> guard(Lock);
+    if (fd >= 0 && SentenceCount < SentenceQueueSize) {
+      pSentence->AddRef();
+      Sentences[(SentenceReadPos + SentenceCount) % SentenceQueueSize] = pSentence;
+      SentenceCount++;
+      Queued = true;
+    }
+  }
+  if (Queued) {
+    DataReady.notify_one();
+  } else {
+    SentencesDropped++;
+  }
+}
+
+//*****************************************************************************
+// Fills iov with queued sentences, first one from where last write ended.
+// Called with Lock held.
+int tNMEA0183AsyncSink::GetSentenceIov(struct iovec *iov) const {
+  int n = 0;
+  for (; n < MaxIov && (size_t)n < SentenceCount; n++) {
+    const tSentence *pSentence = Sentences[(SentenceReadPos + n) % SentenceQueueSize];
+    size_t Offset = (n == 0) ? SentenceOffset : 0;
+    iov[n].iov_base = (void *)(pSentence->GetData() + Offset);
+    iov[n].iov_len = pSentence->GetLen() - Offset;
+  }
+  return n;
+}
+
+//*****************************************************************************
+// Releases sentences written completely. Called with Lock held.
+void tNMEA0183AsyncSink::ConsumeSentences(size_t Len) {
+  while (Len > 0 && SentenceCount > 0) {
+    tSentence *pSentence = Sentences[SentenceReadPos];
+    size_t Left = pSentence->GetLen() - SentenceOffset;
+    if (Len < Left) {
+      SentenceOffset += Len;
+      return;
+    }
+    Len -= Left;
+    SentenceOffset = 0;
+    SentenceReadPos = (SentenceReadPos + 1) % SentenceQueueSize;
+    SentenceCount--;
+    SentencesWritten++;
+    pSentence->Release();
+  }
+}
+
+//*****************************************************************************
+// Drops queued sentences. Called with Lock held, or after writer has stopped.
+void tNMEA0183AsyncSink::ReleaseSentences() {
+  while (SentenceCount > 0) {
+    Sentences[SentenceReadPos]->Release();
+    SentenceReadPos = (SentenceReadPos + 1) % SentenceQueueSize;
+    SentenceCount--;
+    SentencesDropped++;
+  }
+  SentenceReadPos = 0;
+  SentenceOffset = 0;
+}
+
+//*****************************************************************************
+bool tNMEA0183AsyncSink::Connect() {
+  int newfd = open(Path.c_str(), O_WRONLY | O_NONBLOCK | O_APPEND | O_CLOEXEC);
+  if (newfd < 0) {
+    // ENXIO means FIFO exists, but there is no reader yet. Not worth logging.
+    // Others (missing path, permissions) are logged when the reason changes.
+    int Error = errno;
+    if (Error != ENXIO && Error != LastOpenError) {
+      cerr << "Cannot open output " << Path << ": " << strerror(Error) << ", will retry.\n";
+    }
+    LastOpenError = Error;
+    return false;
+  }
+  LastOpenError = 0;
+  {
+    lock_guard<mutex> guard(Lock);
+    fd = newfd;
+  }
+  if (EverConnected) {
+    Reconnects++;
+    cout << "Output " << Path << " reconnected.\n";
+  }
+  EverConnected = true;
+  Connected = true;
+  return true;
+}
+
+//*****************************************************************************
+// Drops the connection and whatever was queued for it. Queued data would be
+// stale by the time a new reader shows up.
+void tNMEA0183AsyncSink::Disconnect(const char *Reason) {
+  lock_guard<mutex> guard(Lock);
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  SentencesDropped += UsedRecords;
+  ReleaseSentences();
+  ReadPos = 0;
+  Used = 0;
+  UsedRecords = 0;
+  Connected = false;
+  cerr << "Output " << Path << " disconnected (" << Reason << "), will reconnect.\n";
+}
+
+//*****************************************************************************
+// Waits until the output can take more data. Returns false if the reader
+// has gone away.
+bool tNMEA0183AsyncSink::WaitWritable() {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+  auto start = chrono::steady_clock::now();
+  int res = poll(&pfd, 1, PollTimeout_ms);
+  BlockedTime_us += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+  if (res < 0) return (errno == EINTR);
+  return (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+}
+
+//*****************************************************************************
+void tNMEA0183AsyncSink::WriterLoop() {
+  unique_lock<mutex> guard(Lock);
+  while (Running) {
+    if (fd < 0) {
+      guard.unlock();
+      bool ok = Connect();
+      guard.lock();
+      if (!ok) DataReady.wait_for(guard, chrono::milliseconds(ReconnectPeriod_ms));
+      continue;
+    }
+    if (Used == 0 && SentenceCount == 0) {
+      DataReady.wait(guard);
+      continue;
+    }
+    ssize_t res;
+    int err;
+    if (SentenceCount > 0) {
+      // Queued sentences are written straight from the shared buffers. The
+      // producer only appends behind them, so no lock is needed for writing.
+      struct iovec iov[MaxIov];
+      int n = GetSentenceIov(iov);
+      guard.unlock();
+      res = ::writev(fd, iov, n);
+      err = errno;
+      guard.lock();
+      if (res > 0) {
+        ConsumeSentences(res);
+        BytesWritten += res;
+      }
+    } else {
+      // Write the contiguous part of the pending data. The producer only
+      // appends behind it, so it is safe to write without holding the lock.
+      size_t Len = BufSize - ReadPos;
+      if (Len > Used) Len = Used;
+      const char *pData = Buf + ReadPos;
+      guard.unlock();
+      res = ::write(fd, pData, Len);
+      err = errno;
+      guard.lock();
+      if (res > 0) {
+        size_t Records = 0;
+        for (ssize_t i = 0; i < res; i++) {
+          if (pData[i] == '\n') Records++;
+        }
+        ReadPos = (ReadPos + res) % BufSize;
+        Used -= res;
+        UsedRecords -= Records;
+        BytesWritten += res;
+        SentencesWritten += Records;
+      }
+    }
+    if (res < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+      guard.unlock();
+      bool ok = WaitWritable();
+      if (!ok) Disconnect("reader closed");
+      guard.lock();
+    } else if (res < 0 && err != EINTR) {
+      guard.unlock();
+      Disconnect(strerror(err));
+      guard.lock();
+    }
+  }
+}
@@ -0,0 +1,117 @@
+/*
+NMEA0183AsyncSink.h
+
+Asynchronous output sink for NMEA0183 sentences.
+
+Sentences written by tNMEA0183 are queued in a bounded ring buffer and
+drained to the output file/FIFO by a dedicated writer thread using
+non-blocking writes. If the reader (e.g. kplex) goes away, the sink drops
+the stale backlog, keeps accepting sentences and reconnects in the
+background, so the conversion loop never blocks on the output.
+
+Shared sentences (see SentencePool.h) are queued by reference instead,
+and written straight from their buffers with writev. A sink is fed
+either way, order between the two is not kept.
+*/
+
+#ifndef NMEA0183_ASYNC_SINK_H
+#define NMEA0183_ASYNC_SINK_H
+
+#include <NMEA0183.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "SentencePool.h"
+
+class tNMEA0183AsyncSink : public tNMEA0183Stream, public tSentenceSink {
+public:
+  struct tStats {
+    uint64_t BytesWritten;
+    uint64_t SentencesWritten;
+    uint64_t SentencesDropped;
+    uint64_t BlockedTime_us;
+    uint32_t Reconnects;
+    bool Connected;
+  };
+
+protected:
+  // Longest single record (sentence incl. CR/LF) we accept from the writer side
+  static const size_t MaxRecordLen=1024;
+  // How long to wait between attempts to (re)open the output
+  static const int ReconnectPeriod_ms=500;
+  // Max time the writer waits for a blocked output before checking state again
+  static const int PollTimeout_ms=100;
+  // Sentences written with one writev
+  static const int MaxIov=64;
+
+  std::string Path;
+  // Ring buffer shared by producer and writer thread, guarded by Lock
+  char *Buf;
+  size_t BufSize;
+  size_t ReadPos;
+  size_t Used;
+  size_t UsedRecords;
+  // Record being assembled by the producer (no lock needed, single producer)
+  char Record[MaxRecordLen];
+  size_t RecordLen;
+  bool RecordOverflow;
+  // Queue of shared sentences, guarded by Lock
+  tSentence **Sentences;
+  size_t SentenceQueueSize;
+  size_t SentenceReadPos;
+  size_t SentenceCount;
+  // Part of first queued sentence already written
+  size_t SentenceOffset;
+
+  int fd;
+  bool EverConnected;
+  // errno of last failed open, so each new reason is logged once
+  int LastOpenError;
+  bool Running;
+  std::mutex Lock;
+  std::condition_variable DataReady;
+  std::thread Writer;
+
+  std::atomic<uint64_t> BytesWritten;
+  std::atomic<uint64_t> SentencesWritten;
+  std::atomic<uint64_t> SentencesDropped;
+  std::atomic<uint64_t> BlockedTime_us;
+  std::atomic<uint32_t> Reconnects;
+  std::atomic<bool> Connected;
+
+protected:
+  void CommitRecord();
+  int GetSentenceIov(struct iovec *iov) const;
+  void ConsumeSentences(size_t Len);
+  void ReleaseSentences();
+  void WriterLoop();
+  bool Connect();
+  void Disconnect(const char *Reason);
+  bool WaitWritable();
+
+public:
+  tNMEA0183AsyncSink(const char *_Path, size_t _BufSize=64*1024);
+  virtual ~tNMEA0183AsyncSink();
+  // Allocates the buffer and starts the writer thread. The output itself
+  // does not have to be available yet, it will be opened when it appears.
+  bool Open();
+  void Close();
+  void GetStats(tStats &Stats) const;
+  std::thread::native_handle_type GetWriterThread() { return Writer.native_handle(); }
+  const std::string& GetPath() const { return Path; }
+  // Shared sentences a sink with buffer size BufSize queues at most
+  static size_t GetSentenceCapacity(size_t BufSize);
+
+  // tSentenceSink
+  void SendSentence(tSentence *pSentence);
+
+  // tNMEA0183Stream
+  int read() { return -1; }
+  size_t write(const uint8_t* data, size_t size);
+};
+
+#endif // NMEA0183_ASYNC_SINK_H
@@ -0,0 +1,135 @@
+/*
+NMEA2000_CANSocket.cpp
+
+NMEA2000 CAN driver for Linux SocketCAN. See header for details.
+*/
+
+#include "NMEA2000_CANSocket.h"
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+using namespace std;
+
+//*****************************************************************************
+tNMEA2000_CANSocket::tNMEA2000_CANSocket(const char *_Interface, int _RcvBufSize)
+  : tNMEA2000(), Interface(_Interface), RcvBufSize(_RcvBufSize), fd(-1),
+    FramesReceived(0), FramesSent(0), SendErrors(0), KernelDrops(0), pAnalyzer(0) {
+  LastFrameTime.tv_sec = 0;
+  LastFrameTime.tv_nsec = 0;
+}
+
+//*****************************************************************************
+tNMEA2000_CANSocket::~tNMEA2000_CANSocket() {
+  if (fd >= 0) close(fd);
+}
+
+//*****************************************************************************
+void tNMEA2000_CANSocket::GetStats(tStats &Stats) const {
+  Stats.FramesReceived = FramesReceived;
+  Stats.FramesSent = FramesSent;
+  Stats.SendErrors = SendErrors;
+  Stats.KernelDrops = KernelDrops;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CANSocket::CANOpen() {
+  if (fd >= 0) return true;
+  fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+  if (fd < 0) {
+    cerr << "Cannot open CAN socket: " << strerror(errno) << "\n";
+    return false;
+  }
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, Interface.c_str(), IFNAMSIZ - 1);
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+    cerr << "Cannot find CAN interface " << Interface << ": " << strerror(errno) << "\n";
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  struct sockaddr_can addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    cerr << "Cannot bind to CAN interface " << Interface << ": " << strerror(errno) << "\n";
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  int on = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) {
+    cerr << "CAN socket kernel drop counting not available: " << strerror(errno) << "\n";
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+    cerr << "CAN socket receive time stamps not available: " << strerror(errno) << "\n";
+  }
+  if (RcvBufSize > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &RcvBufSize, sizeof(RcvBufSize)) < 0) {
+    cerr << "Cannot set CAN socket receive buffer: " << strerror(errno) << "\n";
+  }
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CANSocket::CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool) {
+  struct can_frame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.can_id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  frame.can_dlc = (len > 8) ? 8 : len;
+  memcpy(frame.data, buf, frame.can_dlc);
+  if (write(fd, &frame, sizeof(frame)) != sizeof(frame)) {
+    SendErrors++;
+    return false;
+  }
+  FramesSent++;
+  if (pAnalyzer) pAnalyzer->AddFrame(id & CAN_EFF_MASK, frame.can_dlc, frame.data);
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CANSocket::CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf) {
+  struct can_frame frame;
+  struct iovec iov;
+  struct msghdr msg;
+  char ctrl[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timespec))];
+  iov.iov_base = &frame;
+  iov.iov_len = sizeof(frame);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  while (true) {
+    ssize_t res = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (res != sizeof(frame)) return false;
+    bool Stamped = false;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != 0; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        memcpy(&KernelDrops, CMSG_DATA(cmsg), sizeof(KernelDrops));
+      } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        memcpy(&LastFrameTime, CMSG_DATA(cmsg), sizeof(LastFrameTime));
+        Stamped = true;
+      }
+    }
+    // NMEA2000 only uses extended data frames
+    if ((frame.can_id & CAN_EFF_FLAG) == 0 || (frame.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0) {
+      msg.msg_controllen = sizeof(ctrl);
+      continue;
+    }
+    if (!Stamped) clock_gettime(CLOCK_REALTIME, &LastFrameTime);
+    FramesReceived++;
+    id = frame.can_id & CAN_EFF_MASK;
+    len = (frame.can_dlc > 8) ? 8 : frame.can_dlc;
+    memcpy(buf, frame.data, len);
+    if (pAnalyzer) pAnalyzer->AddFrame(id, len, buf);
+    return true;
+  }
+}
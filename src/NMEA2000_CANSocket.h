@@ -0,0 +1,58 @@
+/*
+NMEA2000_CANSocket.h
+
+NMEA2000 CAN driver for Linux SocketCAN. Same job as tNMEA2000_SocketCAN,
+but keeps receive statistics: frames received and frames the kernel had
+to drop because we did not read the socket fast enough (SO_RXQ_OVFL).
+Also keeps the kernel receive time stamp of the last frame (SO_TIMESTAMPNS)
+and can feed all frames to a bus analyzer.
+*/
+
+#ifndef NMEA2000_CAN_SOCKET_H
+#define NMEA2000_CAN_SOCKET_H
+
+#include <NMEA2000.h>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include "BusAnalyzer.h"
+
+class tNMEA2000_CANSocket : public tNMEA2000 {
+public:
+  struct tStats {
+    uint64_t FramesReceived;
+    uint64_t FramesSent;
+    uint64_t SendErrors;
+    uint64_t KernelDrops;
+  };
+
+protected:
+  std::string Interface;
+  int RcvBufSize;
+  int fd;
+  uint64_t FramesReceived;
+  uint64_t FramesSent;
+  uint64_t SendErrors;
+  // Kernel drop counter is cumulative for the socket lifetime
+  uint32_t KernelDrops;
+  struct timespec LastFrameTime;
+  tBusAnalyzer *pAnalyzer;
+
+public:
+  // _RcvBufSize is socket receive buffer size in bytes, 0 for system default
+  tNMEA2000_CANSocket(const char *_Interface, int _RcvBufSize=0);
+  virtual ~tNMEA2000_CANSocket();
+  void GetStats(tStats &Stats) const;
+  // CLOCK_REALTIME time the kernel received the last frame returned by
+  // CANGetFrame, i.e. the frame completing the message being handled.
+  const struct timespec& GetLastFrameTime() const { return LastFrameTime; }
+  // Every frame received or sent is also given to analyzer
+  void SetAnalyzer(tBusAnalyzer *_pAnalyzer) { pAnalyzer = _pAnalyzer; }
+
+  // tNMEA2000
+  bool CANOpen();
+  bool CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true);
+  bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf);
+};
+
+#endif // NMEA2000_CAN_SOCKET_H
@@ -0,0 +1,223 @@
+/*
+NMEA2000_CANUDP.cpp
+
+NMEA2000 CAN driver receiving frames over UDP. See header for details.
+*/
+
+#include "NMEA2000_CANUDP.h"
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+const size_t tNMEA2000_CANUDP::WindowSize;
+const uint64_t tNMEA2000_CANUDP::ReorderTimeout_us;
+
+//*****************************************************************************
+tNMEA2000_CANUDP::tNMEA2000_CANUDP(const char *_Listen, int _RcvBufSize)
+  : tNMEA2000(), Listen(_Listen), RcvBufSize(_RcvBufSize), fd(-1), CurrentFrame(0),
+    HeldCount(0), Synced(false), Session(0), NextSeq(0),
+    FramesReceived(0), FramesLost(0), DatagramsReceived(0), DatagramsReordered(0),
+    DatagramsLate(0), BadDatagrams(0), SenderRestarts(0), BridgeKernelDrops(0) {
+  Current.Used = false;
+  for (size_t i = 0; i <= WindowSize; i++) Held[i].Used = false;
+  LastFrameTime.tv_sec = 0;
+  LastFrameTime.tv_nsec = 0;
+}
+
+//*****************************************************************************
+tNMEA2000_CANUDP::~tNMEA2000_CANUDP() {
+  if (fd >= 0) close(fd);
+}
+
+//*****************************************************************************
+void tNMEA2000_CANUDP::GetStats(tStats &Stats) const {
+  Stats.FramesReceived = FramesReceived;
+  Stats.FramesLost = FramesLost;
+  Stats.DatagramsReceived = DatagramsReceived;
+  Stats.DatagramsReordered = DatagramsReordered;
+  Stats.DatagramsLate = DatagramsLate;
+  Stats.BadDatagrams = BadDatagrams;
+  Stats.SenderRestarts = SenderRestarts;
+  Stats.BridgeKernelDrops = BridgeKernelDrops;
+}
+
+//*****************************************************************************
+uint64_t tNMEA2000_CANUDP::Monotonic_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CANUDP::CANOpen() {
+  if (fd >= 0) return true;
+  char Host[64];
+  uint16_t Port;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (!ParseHostPort(Listen.c_str(), Host, sizeof(Host), Port) ||
+      (Host[0] != 0 && inet_pton(AF_INET, Host, &addr.sin_addr) != 1)) {
+    cerr << "Bad UDP input address: " << Listen << "\n";
+    return false;
+  }
+  addr.sin_port = htons(Port);
+  fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    cerr << "Cannot open UDP socket: " << strerror(errno) << "\n";
+    return false;
+  }
+  if (RcvBufSize > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &RcvBufSize, sizeof(RcvBufSize)) < 0) {
+    cerr << "Cannot set UDP socket receive buffer: " << strerror(errno) << "\n";
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    cerr << "Cannot bind UDP input " << Listen << ": " << strerror(errno) << "\n";
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  return true;
+}
+
+//*****************************************************************************
+// Nothing goes back to the bus
+bool tNMEA2000_CANUDP::CANSendFrame(unsigned long, unsigned char, const unsigned char *, bool) {
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CANUDP::CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf) {
+  while (true) {
+    if (Current.Used && CurrentFrame < Current.Header.FrameCount) {
+      tCANUDPFrame Frame;
+      tCANUDP::DecodeFrame(Current.Data, CurrentFrame++, Frame);
+      LastFrameTime.tv_sec = Frame.Time_us / 1000000;
+      LastFrameTime.tv_nsec = (Frame.Time_us % 1000000) * 1000;
+      FramesReceived++;
+      id = Frame.Id;
+      len = Frame.Len;
+      memcpy(buf, Frame.Data, len);
+      return true;
+    }
+    Current.Used = false;
+    if (TakeHeld() || ReceiveDatagram() || SkipGap(false)) continue;
+    return false;
+  }
+}
+
+//*****************************************************************************
+// Reads one datagram. It becomes Current, if it is next in sequence, or is
+// held, if it is ahead. Returns false, if there was nothing to read.
+bool tNMEA2000_CANUDP::ReceiveDatagram() {
+  while (true) {
+    ssize_t res = recv(fd, RxBuf, sizeof(RxBuf), MSG_DONTWAIT);
+    if (res < 0) return false;
+    tCANUDPHeader Header;
+    if (!tCANUDP::DecodeHeader(RxBuf, res, Header)) {
+      BadDatagrams++;
+      continue;
+    }
+    DatagramsReceived++;
+    BridgeKernelDrops = Header.KernelDrops;
+    if (!Synced || Header.Session != Session) {
+      if (Synced) {
+        SenderRestarts++;
+        cerr << "CAN bridge restarted, new session.\n";
+      }
+      for (size_t i = 0; i <= WindowSize; i++) Held[i].Used = false;
+      HeldCount = 0;
+      Session = Header.Session;
+      NextSeq = Header.FirstSeq;
+      Synced = true;
+    }
+    int32_t Ahead = (int32_t)(Header.FirstSeq - NextSeq);
+    if (Ahead < 0) {
+      DatagramsLate++;
+      continue;
+    }
+    tDatagram *pSlot = &Current;
+    if (Ahead > 0) {
+      if (IsHeld(Header.FirstSeq)) {
+        DatagramsLate++;
+        continue;
+      }
+      DatagramsReordered++;
+      for (pSlot = Held; pSlot->Used; pSlot++) ;
+      HeldCount++;
+    } else {
+      NextSeq += Header.FrameCount;
+      CurrentFrame = 0;
+    }
+    pSlot->Used = true;
+    pSlot->Header = Header;
+    pSlot->Arrival_us = Monotonic_us();
+    memcpy(pSlot->Data, RxBuf, res);
+    // Window has one spare slot, so a full window is noticed only here
+    if (HeldCount > WindowSize) SkipGap(true);
+    return true;
+  }
+}
+
+//*****************************************************************************
+bool tNMEA2000_CANUDP::IsHeld(uint32_t FirstSeq) const {
+  for (size_t i = 0; i <= WindowSize; i++) {
+    if (Held[i].Used && Held[i].Header.FirstSeq == FirstSeq) return true;
+  }
+  return false;
+}
+
+//*****************************************************************************
+// Drops held datagrams, which sequence has already passed
+void tNMEA2000_CANUDP::DropPassedHeld() {
+  for (size_t i = 0; i <= WindowSize && HeldCount > 0; i++) {
+    if (Held[i].Used && (int32_t)(Held[i].Header.FirstSeq - NextSeq) < 0) {
+      Held[i].Used = false;
+      HeldCount--;
+      DatagramsLate++;
+    }
+  }
+}
+
+//*****************************************************************************
+// Makes the held datagram next in sequence Current
+bool tNMEA2000_CANUDP::TakeHeld() {
+  DropPassedHeld();
+  if (HeldCount == 0) return false;
+  for (size_t i = 0; i <= WindowSize; i++) {
+    if (Held[i].Used && Held[i].Header.FirstSeq == NextSeq) {
+      Current = Held[i];
+      Held[i].Used = false;
+      HeldCount--;
+      CurrentFrame = 0;
+      NextSeq += Current.Header.FrameCount;
+      return true;
+    }
+  }
+  return false;
+}
+
+//*****************************************************************************
+// Gives up waiting for the missing frames before the oldest held datagram,
+// when forced or it has waited long enough.
+bool tNMEA2000_CANUDP::SkipGap(bool Force) {
+  DropPassedHeld();
+  if (HeldCount == 0) return false;
+  tDatagram *pOldest = 0;
+  for (size_t i = 0; i <= WindowSize; i++) {
+    if (!Held[i].Used) continue;
+    if (pOldest == 0 || (int32_t)(Held[i].Header.FirstSeq - pOldest->Header.FirstSeq) < 0) {
+      pOldest = &Held[i];
+    }
+  }
+  if (!Force && Monotonic_us() - pOldest->Arrival_us < ReorderTimeout_us) return false;
+  FramesLost += pOldest->Header.FirstSeq - NextSeq;
+  NextSeq = pOldest->Header.FirstSeq;
+  return true;
+}
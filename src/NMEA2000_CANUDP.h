@@ -0,0 +1,96 @@
+/*
+NMEA2000_CANUDP.h
+
+NMEA2000 CAN driver receiving frames over UDP from a CAN bridge
+(see CANUDP.h for the format), so conversion can run on another host
+than the one owning the CAN port.
+
+Datagrams carry frame sequence numbers. Datagrams arriving ahead of a
+missing one are held in a small reorder window; the gap is given up and
+its frames counted as lost when the window fills or the oldest held
+datagram has waited ReorderTimeout_us. Late and duplicate datagrams are
+dropped, also held ones the sequence has passed. A new bridge session (bridge restart) resets the sequence.
+
+Frames sent by the library are not bridged back to the bus.
+*/
+
+#ifndef NMEA2000_CAN_UDP_H
+#define NMEA2000_CAN_UDP_H
+
+#include <NMEA2000.h>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include "CANUDP.h"
+
+class tNMEA2000_CANUDP : public tNMEA2000 {
+public:
+  struct tStats {
+    uint64_t FramesReceived;
+    uint64_t FramesLost;
+    uint64_t DatagramsReceived;
+    uint64_t DatagramsReordered;
+    uint64_t DatagramsLate;
+    uint64_t BadDatagrams;
+    uint32_t SenderRestarts;
+    uint32_t BridgeKernelDrops;
+  };
+
+protected:
+  static const size_t WindowSize=8;
+  static const uint64_t ReorderTimeout_us=20000;
+
+  struct tDatagram {
+    bool Used;
+    tCANUDPHeader Header;
+    uint64_t Arrival_us;
+    uint8_t Data[tCANUDP::MaxDatagramSize];
+  };
+
+  std::string Listen;
+  int RcvBufSize;
+  int fd;
+  // Datagram being handed out frame by frame
+  tDatagram Current;
+  size_t CurrentFrame;
+  // Datagrams arrived ahead of sequence, one spare for the one overflowing
+  tDatagram Held[WindowSize+1];
+  size_t HeldCount;
+  bool Synced;
+  uint32_t Session;
+  uint32_t NextSeq;
+  uint8_t RxBuf[tCANUDP::MaxDatagramSize+1];
+  struct timespec LastFrameTime;
+
+  uint64_t FramesReceived;
+  uint64_t FramesLost;
+  uint64_t DatagramsReceived;
+  uint64_t DatagramsReordered;
+  uint64_t DatagramsLate;
+  uint64_t BadDatagrams;
+  uint32_t SenderRestarts;
+  uint32_t BridgeKernelDrops;
+
+  bool ReceiveDatagram();
+  bool IsHeld(uint32_t FirstSeq) const;
+  void DropPassedHeld();
+  bool TakeHeld();
+  bool SkipGap(bool Force);
+  static uint64_t Monotonic_us();
+
+public:
+  // _Listen is "port" or "address:port", _RcvBufSize socket receive buffer
+  // size in bytes, 0 for system default
+  tNMEA2000_CANUDP(const char *_Listen, int _RcvBufSize=0);
+  virtual ~tNMEA2000_CANUDP();
+  void GetStats(tStats &Stats) const;
+  // Bridge receive time of the last frame returned by CANGetFrame
+  const struct timespec& GetLastFrameTime() const { return LastFrameTime; }
+
+  // tNMEA2000
+  bool CANOpen();
+  bool CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true);
+  bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf);
+};
+
+#endif // NMEA2000_CAN_UDP_H
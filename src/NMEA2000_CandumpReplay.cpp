@@ -0,0 +1,222 @@
+/*
+NMEA2000_CandumpReplay.cpp
+
+NMEA2000 CAN driver replaying candump captures. See header for details.
+*/
+
+#include "NMEA2000_CandumpReplay.h"
+#include <iostream>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+//*****************************************************************************
+tNMEA2000_CandumpReplay::tNMEA2000_CandumpReplay(const char *_FileName, uint64_t _FrameInterval_us)
+  : tNMEA2000(), FileName(_FileName), File(0), FrameInterval_us(_FrameInterval_us),
+    SyntheticTime_us(0), ReleaseTime_us(0), LastFrameTime_us(0), FramesRead(0), BadLines(0),
+    StartOffset(0), EndOffset(-1), Offset(0), FrameHasTime(false),
+    HasFrame(false), FrameId(0), FrameLen(0), FrameTime_us(0) {
+  Line[0] = 0;
+}
+
+//*****************************************************************************
+tNMEA2000_CandumpReplay::~tNMEA2000_CandumpReplay() {
+  if (File) fclose(File);
+}
+
+//*****************************************************************************
+bool tNMEA2000_CandumpReplay::CANOpen() {
+  if (File) return true;
+  File = fopen(FileName.c_str(), "r");
+  if (File == 0) {
+    cerr << "Cannot open replay file: " << FileName << "\n";
+    return false;
+  }
+  if (StartOffset > 0 && fseek(File, StartOffset, SEEK_SET) != 0) {
+    cerr << "Cannot seek replay file: " << FileName << "\n";
+    return false;
+  }
+  Offset = StartOffset;
+  ReadFrame();
+  LastFrameTime_us = FrameTime_us;
+  return true;
+}
+
+//*****************************************************************************
+// Nothing is sent anywhere during replay
+bool tNMEA2000_CandumpReplay::CANSendFrame(unsigned long, unsigned char, const unsigned char *, bool) {
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CandumpReplay::CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf) {
+  if (!HasFrame || FrameTime_us > ReleaseTime_us) return false;
+  id = FrameId;
+  len = FrameLen;
+  memcpy(buf, FrameData, FrameLen);
+  LastFrameTime_us = FrameTime_us;
+  FramesRead++;
+  ReadFrame();
+  return true;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CandumpReplay::ReadFrame() {
+  HasFrame = false;
+  while ((EndOffset < 0 || Offset < EndOffset) && fgets(Line, MaxLineLen, File) != 0) {
+    Offset += strlen(Line);
+    if (ParseLine(Line)) {
+      HasFrame = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+//*****************************************************************************
+// Parses one capture line into Frame*. Returns false for lines without a
+// frame (blank, comments) or ones we cannot parse.
+bool tNMEA2000_CandumpReplay::ParseLine(char *pLine) {
+  char *p = pLine;
+  char *end;
+  bool HasTime = false;
+  FrameHasTime = false;
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == 0 || *p == '\n' || *p == '\r' || *p == '#') return false;
+  // Optional "(seconds.fraction)" time stamp
+  if (*p == '(') {
+    double Time = strtod(p + 1, &end);
+    if (end == p + 1 || *end != ')') { BadLines++; return false; }
+    FrameTime_us = (uint64_t)(Time * 1e6 + 0.5);
+    HasTime = true;
+    FrameHasTime = true;
+    p = end + 1;
+    while (*p == ' ' || *p == '\t') p++;
+  }
+  if (*p == '<') {
+    // <0x18eeff01> [8] 05 a0 ...
+    FrameId = strtoul(p + 1, &end, 16);
+    if (*end != '>') { BadLines++; return false; }
+    p = end + 1;
+  } else {
+    // Skip interface name, then id as "18EEFF01#..." or "18EEFF01 [8] ..."
+    char *Token = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '#') p++;
+    if (*p != '#') {
+      while (*p == ' ' || *p == '\t') p++;
+      Token = p;
+    }
+    FrameId = strtoul(Token, &end, 16);
+    if (end == Token) { BadLines++; return false; }
+    p = end;
+    if (*p == '#') {
+      // Data as continuous hex string
+      p++;
+      FrameLen = 0;
+      while (FrameLen < 8 && isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1])) {
+        char Hex[3] = { p[0], p[1], 0 };
+        FrameData[FrameLen++] = strtoul(Hex, 0, 16);
+        p += 2;
+      }
+      FrameId &= 0x1fffffff;
+      if (!HasTime) { FrameTime_us = SyntheticTime_us; SyntheticTime_us += FrameInterval_us; }
+      return true;
+    }
+  }
+  // " [len] b0 b1 ..."
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p != '[') { BadLines++; return false; }
+  unsigned long Len = strtoul(p + 1, &end, 10);
+  if (*end != ']' || Len > 8) { BadLines++; return false; }
+  p = end + 1;
+  for (FrameLen = 0; FrameLen < Len; FrameLen++) {
+    FrameData[FrameLen] = strtoul(p, &end, 16);
+    if (end == p) { BadLines++; return false; }
+    p = end;
+  }
+  FrameId &= 0x1fffffff;
+  if (!HasTime) { FrameTime_us = SyntheticTime_us; SyntheticTime_us += FrameInterval_us; }
+  return true;
+}
+
+//*****************************************************************************
+// Reads time of first time stamped frame line starting after From (or at 0).
+// Frame fields are used as scratch, so this must not be used during replay.
+bool tNMEA2000_CandumpReplay::ReadTimeAfter(FILE *pFile, long From, long &LineOffset, uint64_t &Time_us) {
+  if (fseek(pFile, From, SEEK_SET) != 0) return false;
+  long Pos = From;
+  uint64_t SavedBadLines = BadLines;
+  bool Found = false;
+  // Skip partial line, unless we are at start of file
+  if (From > 0) {
+    if (fseek(pFile, From - 1, SEEK_SET) != 0 || fgets(Line, MaxLineLen, pFile) == 0) return false;
+    Pos = From - 1 + strlen(Line);
+  }
+  while (fgets(Line, MaxLineLen, pFile) != 0) {
+    long Start = Pos;
+    Pos += strlen(Line);
+    if (ParseLine(Line) && FrameHasTime) {
+      LineOffset = Start;
+      Time_us = FrameTime_us;
+      Found = true;
+      break;
+    }
+  }
+  BadLines = SavedBadLines;
+  return Found;
+}
+
+//*****************************************************************************
+long tNMEA2000_CandumpReplay::FindTimeOffset(uint64_t Time_us) {
+  FILE *pFile = fopen(FileName.c_str(), "r");
+  if (pFile == 0) return -1;
+  fseek(pFile, 0, SEEK_END);
+  long Size = ftell(pFile);
+  long LineOffset;
+  uint64_t LineTime;
+  // Narrow down to a range of a few lines, which is then scanned
+  long Low = 0, High = Size;
+  while (High - Low > (long)MaxLineLen * 4) {
+    long Mid = Low + (High - Low) / 2;
+    if (ReadTimeAfter(pFile, Mid, LineOffset, LineTime) && LineTime < Time_us) {
+      Low = Mid;
+    } else {
+      High = Mid;
+    }
+  }
+  long Result = Size;
+  long From = Low;
+  while (ReadTimeAfter(pFile, From, LineOffset, LineTime)) {
+    if (LineTime >= Time_us) {
+      Result = LineOffset;
+      break;
+    }
+    From = LineOffset + 1;
+  }
+  fclose(pFile);
+  return Result;
+}
+
+//*****************************************************************************
+bool tNMEA2000_CandumpReplay::GetTimeSpan(uint64_t &First_us, uint64_t &Last_us) {
+  FILE *pFile = fopen(FileName.c_str(), "r");
+  if (pFile == 0) return false;
+  long LineOffset;
+  bool Result = ReadTimeAfter(pFile, 0, LineOffset, First_us);
+  if (Result) {
+    // Last time stamp is within the last few lines
+    fseek(pFile, 0, SEEK_END);
+    long Size = ftell(pFile);
+    long From = (Size > (long)MaxLineLen * 4) ? Size - (long)MaxLineLen * 4 : 0;
+    uint64_t Time_us;
+    Last_us = First_us;
+    while (ReadTimeAfter(pFile, From, LineOffset, Time_us)) {
+      Last_us = Time_us;
+      From = LineOffset + 1;
+    }
+  }
+  fclose(pFile);
+  return Result;
+}
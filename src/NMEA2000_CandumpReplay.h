@@ -0,0 +1,91 @@
+/*
+NMEA2000_CandumpReplay.h
+
+NMEA2000 "CAN driver" that replays frames from a candump capture instead
+of reading a CAN port. Understands the formats we have captures in:
+
+  <0x18eeff01> [8] 05 a0 be 1c 00 a0 a0 c0          (test/candumpSample1.txt)
+  (1545000000.123456) can0 18EEFF01#05A0BE1C00A0A0C0  (candump -l)
+  (1545000000.123456)  can0  18EEFF01   [8]  05 A0 BE ...  (candump -ta)
+  can0  18EEFF01   [8]  05 A0 BE 1C 00 A0 A0 C0      (candump)
+
+Captures without timestamps get one frame every FrameInterval_us. Frames
+are only handed to the library once their time has been released with
+ReleaseUntil(), which lets the caller replay in real time, faster, or as
+fast as possible.
+
+Time stamped captures can also be split: FindTimeOffset() locates a time
+in the file by binary search, and SetRange() limits replay to a part of it.
+*/
+
+#ifndef NMEA2000_CANDUMP_REPLAY_H
+#define NMEA2000_CANDUMP_REPLAY_H
+
+#include <NMEA2000.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+class tNMEA2000_CandumpReplay : public tNMEA2000 {
+protected:
+  static const size_t MaxLineLen=256;
+
+  std::string FileName;
+  FILE *File;
+  char Line[MaxLineLen];
+  uint64_t FrameInterval_us;
+  uint64_t SyntheticTime_us;
+  uint64_t ReleaseTime_us;
+  uint64_t LastFrameTime_us;
+  uint64_t FramesRead;
+  uint64_t BadLines;
+  // Byte range of lines to replay, EndOffset<0 for end of file
+  long StartOffset;
+  long EndOffset;
+  long Offset;
+  bool FrameHasTime;
+  // Next frame, read ahead from file
+  bool HasFrame;
+  unsigned long FrameId;
+  unsigned char FrameLen;
+  unsigned char FrameData[8];
+  uint64_t FrameTime_us;
+
+  bool ReadFrame();
+  bool ParseLine(char *pLine);
+  bool ReadTimeAfter(FILE *pFile, long From, long &LineOffset, uint64_t &Time_us);
+
+public:
+  tNMEA2000_CandumpReplay(const char *_FileName, uint64_t _FrameInterval_us=50000);
+  virtual ~tNMEA2000_CandumpReplay();
+
+  // Frames with time up to Time_us may be read
+  void ReleaseUntil(uint64_t Time_us) { ReleaseTime_us = Time_us; }
+  void ReleaseAll() { ReleaseTime_us = UINT64_MAX; }
+  // Time (us) of next frame in file, or of last one at end of file
+  uint64_t GetNextFrameTime() const { return HasFrame ? FrameTime_us : LastFrameTime_us; }
+  // Time (us) of last frame given to the library
+  uint64_t GetLastFrameTime() const { return LastFrameTime_us; }
+  bool AtEnd() const { return File != 0 && !HasFrame; }
+  bool HasReleasedFrame() const { return HasFrame && FrameTime_us <= ReleaseTime_us; }
+  uint64_t GetFramesRead() const { return FramesRead; }
+  uint64_t GetBadLines() const { return BadLines; }
+
+  // Limits replay to lines starting at byte offsets [_StartOffset, _EndOffset).
+  // _EndOffset<0 means end of file. Call before Open().
+  void SetRange(long _StartOffset, long _EndOffset) { StartOffset = _StartOffset; EndOffset = _EndOffset; }
+  // Returns offset of first line with frame time >= Time_us, or file size if
+  // there is none. Capture must be time stamped and in time order. Uses its
+  // own file handle, so it can be called before Open(). Returns -1 on error.
+  long FindTimeOffset(uint64_t Time_us);
+  // Time of first and last frame in file. Returns false, if the capture has
+  // no time stamps.
+  bool GetTimeSpan(uint64_t &First_us, uint64_t &Last_us);
+
+  // tNMEA2000
+  bool CANOpen();
+  bool CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent=true);
+  bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf);
+};
+
+#endif // NMEA2000_CANDUMP_REPLAY_H
@@ -0,0 +1,87 @@
+/*
+NTPShm.cpp
+
+NTP shared memory reference clock driver. See header for details.
+*/
+
+#include "NTPShm.h"
+#include <iostream>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+using namespace std;
+
+//*****************************************************************************
+tNTPShm::tNTPShm(int _Unit, int _Precision)
+  : Unit(_Unit), Precision(_Precision), pShm(0), LastReference(0),
+    Samples(0), LastOffset(0), JitterSquared(0) {
+}
+
+//*****************************************************************************
+tNTPShm::~tNTPShm() {
+  if (pShm) shmdt((const void *)pShm);
+}
+
+//*****************************************************************************
+bool tNTPShm::Open() {
+  // Units 0 and 1 are only accessible by root, like ntpd expects
+  int Perms = (Unit < 2) ? 0600 : 0666;
+  int id = shmget(ShmKeyBase + Unit, sizeof(tShmTime), IPC_CREAT | Perms);
+  if (id < 0) {
+    cerr << "Cannot get NTP SHM segment for unit " << Unit << ": " << strerror(errno) << "\n";
+    return false;
+  }
+  void *p = shmat(id, 0, 0);
+  if (p == (void *)-1) {
+    cerr << "Cannot attach NTP SHM segment for unit " << Unit << ": " << strerror(errno) << "\n";
+    return false;
+  }
+  pShm = (volatile tShmTime *)p;
+  pShm->valid = 0;
+  return true;
+}
+
+//*****************************************************************************
+bool tNTPShm::Update(const struct timespec &Receive, const struct timespec &Reference) {
+  if (pShm == 0) return false;
+  double ReferenceTime = Reference.tv_sec + Reference.tv_nsec * 1e-9;
+  // Same fix reported again (e.g. by two handlers) is not a new sample
+  if (ReferenceTime == LastReference) return false;
+  LastReference = ReferenceTime;
+  // Mode 1: reader checks that count did not change while it read values
+  pShm->mode = 1;
+  pShm->count++;
+  __sync_synchronize();
+  pShm->clockTimeStampSec = Reference.tv_sec;
+  pShm->clockTimeStampUSec = Reference.tv_nsec / 1000;
+  pShm->clockTimeStampNSec = Reference.tv_nsec;
+  pShm->receiveTimeStampSec = Receive.tv_sec;
+  pShm->receiveTimeStampUSec = Receive.tv_nsec / 1000;
+  pShm->receiveTimeStampNSec = Receive.tv_nsec;
+  pShm->leap = 0;
+  pShm->precision = Precision;
+  pShm->nsamples = 3;
+  __sync_synchronize();
+  pShm->count++;
+  pShm->valid = 1;
+  // Statistics
+  double Offset = (Receive.tv_sec - Reference.tv_sec) + (Receive.tv_nsec - Reference.tv_nsec) * 1e-9;
+  if (Samples > 0) {
+    double Diff = Offset - LastOffset;
+    // Exponential average like ntpd, weight 1/8
+    JitterSquared += (Diff * Diff - JitterSquared) / 8.0;
+  }
+  LastOffset = Offset;
+  Samples++;
+  return true;
+}
+
+//*****************************************************************************
+void tNTPShm::GetStats(tStats &Stats) const {
+  Stats.Samples = Samples;
+  Stats.LastOffset = LastOffset;
+  Stats.Jitter = sqrt(JitterSquared);
+}
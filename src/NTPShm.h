@@ -0,0 +1,66 @@
+/*
+NTPShm.h
+
+NTP shared memory reference clock driver (ntpd refclock type 28, chrony
+"refclock SHM"). Feeds GNSS time from NMEA2000 straight to the time daemon,
+with the kernel CAN receive time stamp as the local receive time, so there
+is no text conversion and pipe chain in between.
+
+Also keeps statistics of the offset between receive and reference time:
+its last value and jitter (RMS of differences between consecutive samples).
+*/
+
+#ifndef NTP_SHM_H
+#define NTP_SHM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+class tNTPShm {
+public:
+  struct tStats {
+    uint64_t Samples;
+    double LastOffset;
+    double Jitter;
+  };
+
+protected:
+  static const key_t ShmKeyBase=0x4e545030; // "NTP0"
+  // Segment layout shared with ntpd/chrony
+  struct tShmTime {
+    int mode;
+    volatile int count;
+    time_t clockTimeStampSec;
+    int clockTimeStampUSec;
+    time_t receiveTimeStampSec;
+    int receiveTimeStampUSec;
+    int leap;
+    int precision;
+    int nsamples;
+    volatile int valid;
+    unsigned clockTimeStampNSec;
+    unsigned receiveTimeStampNSec;
+    int dummy[8];
+  };
+
+  int Unit;
+  int Precision;
+  volatile tShmTime *pShm;
+  double LastReference;
+  uint64_t Samples;
+  double LastOffset;
+  double JitterSquared;
+
+public:
+  // Precision is log2 of seconds, e.g. -10 for about 1 ms
+  tNTPShm(int _Unit, int _Precision=-10);
+  ~tNTPShm();
+  bool Open();
+  // Publishes new sample. Reference is the time GNSS says it is, Receive
+  // when we received it. Returns false if the sample was not used.
+  bool Update(const struct timespec &Receive, const struct timespec &Reference);
+  void GetStats(tStats &Stats) const;
+};
+
+#endif // NTP_SHM_H
@@ -8,10 +8,27 @@ using namespace std;
 
 const string default_config_file = "/etc/n2kconvert.conf";
 const string default_can_port = "can0";
+const unsigned default_can_rcvbuf_kb = 0;
+const string default_udp_in = "";
+const string default_bridge_dest = "";
 const string default_aux_in_serial = "";
 const string default_aux_in_baud = "";
 const string default_out_stream = "/dev/stdout";
+const string default_out_format = "nmea0183";
+const string default_out2_stream = "";
+const string default_out2_format = "signalk";
+const unsigned default_out_buffer_kb = 64;
+const string default_metrics_file = "";
+const unsigned default_metrics_period_s = 10;
 const double default_depth_offset_ft = 0.0;
+const double default_replay_speed = 1.0;
+const string default_heap_guard = "off";
+const int default_ntp_shm_unit = -1;
+const string default_coalesce_pgns = "";
+const string default_wmm_file = "";
+const string default_columns_file = "";
+const double default_columns_period_s = 1.0;
+const string default_analyzer_file = "";
 const string debug_stream = "/dev/stdout";
 
 bool SetOptions(int argc, char* argv[],
@@ -21,7 +38,27 @@ bool SetOptions(int argc, char* argv[],
   string* aux_in_baud,
   string* out_stream,
   string* fwd_stream,
+  string* out_format,
+  string* out2_stream,
+  string* out2_format,
+  unsigned* out_buffer_kb,
+  string* metrics_file,
+  unsigned* metrics_period_s,
   double* depth_offset_ft,
+  tRealtimeOptions* realtime,
+  tDampingOptions* damping,
+  unsigned* can_rcvbuf_kb,
+  string* udp_in,
+  string* bridge_dest,
+  string* replay_file,
+  double* replay_speed,
+  string* heap_guard,
+  int* ntp_shm_unit,
+  string* coalesce_pgns,
+  string* wmm_file,
+  string* columns_file,
+  double* columns_period_s,
+  string* analyzer_file,
   bool* debug_mode
   ) {
   *debug_mode = false;
@@ -30,16 +67,68 @@ bool SetOptions(int argc, char* argv[],
   options_generic.add_options()
     ("canport,c", po::value<string>(can_port)->default_value(default_can_port),
       "CAN port to read")
+    ("canrcvbuf", po::value<unsigned>(can_rcvbuf_kb)->default_value(default_can_rcvbuf_kb),
+      "CAN socket receive buffer (kB), 0 for system default")
+    ("udpin", po::value<string>(udp_in)->default_value(default_udp_in),
+      "receive CAN frames from a bridge over UDP on [address:]port instead of reading CAN port")
+    ("bridge", po::value<string>(bridge_dest)->default_value(default_bridge_dest),
+      "bridge mode: forward CAN port frames over UDP to host:port, no conversion")
     ("auxin,a", po::value<string>(aux_in_serial)->default_value(default_aux_in_serial),
       "aux serial input of NMEA0183 to overwrite or enhance NMEA2000")
     ("auxinbaud,b", po::value<string>(aux_in_baud)->default_value(default_aux_in_baud),
       "aux serial input baud rate")
     ("output,o", po::value<string>(out_stream)->default_value(default_out_stream),
       "output file/FIFO to send NMEA0183 sentences")
+    ("outputformat", po::value<string>(out_format)->default_value(default_out_format),
+      "output format: nmea0183 or signalk (Signal K delta JSON lines)")
+    ("output2", po::value<string>(out2_stream)->default_value(default_out2_stream),
+      "second output file/FIFO (empty to disable)")
+    ("output2format", po::value<string>(out2_format)->default_value(default_out2_format),
+      "second output format: nmea0183 or signalk")
     ("forward", po::value<string>(fwd_stream),
       "output file/FIFO to forward NMEA2000 data")
+    ("outbuf", po::value<unsigned>(out_buffer_kb)->default_value(default_out_buffer_kb),
+      "output buffer size (kB). Sentences are dropped when the reader falls this far behind")
+    ("metrics", po::value<string>(metrics_file)->default_value(default_metrics_file),
+      "file to periodically write metrics to (empty to disable)")
+    ("metricsperiod", po::value<unsigned>(metrics_period_s)->default_value(default_metrics_period_s),
+      "metrics update period (s), at least 1")
     ("depth,d", po::value<double>(depth_offset_ft)->default_value(default_depth_offset_ft),
       "depth offset (ft) to apply to transducer (DPT message)")
+    ("heapguard", po::value<string>(heap_guard)->default_value(default_heap_guard),
+      "heap allocations in main loop: off, count or trap (abort)")
+    ("ntpshm", po::value<int>(ntp_shm_unit)->default_value(default_ntp_shm_unit),
+      "NTP SHM unit to feed GNSS time to (chrony/ntpd), -1 to disable")
+    ("coalesce", po::value<string>(coalesce_pgns)->default_value(default_coalesce_pgns),
+      "PGNs (e.g. 127250,130306) of which only the newest per source is converted each cycle")
+    ("wmm", po::value<string>(wmm_file)->default_value(default_wmm_file),
+      "World Magnetic Model coefficient file (WMM.COF) for variation when none is on the bus")
+    ("columns", po::value<string>(columns_file)->default_value(default_columns_file),
+      "columnar time series file of decoded values for analysis tools")
+    ("columnsperiod", po::value<double>(columns_period_s)->default_value(default_columns_period_s),
+      "time series row period (s)")
+    ("analyzer", po::value<string>(analyzer_file)->default_value(default_analyzer_file),
+      "bus load and per-device traffic metrics file, updated every second")
+    ("realtime.priority", po::value<int>(&realtime->Priority)->default_value(0),
+      "SCHED_FIFO priority (1-99) of conversion loop, 0 to use normal scheduling")
+    ("realtime.cpus", po::value<string>(&realtime->LoopCPUs)->default_value(""),
+      "CPUs (e.g. 3 or 2-3) to pin receive/convert loop to")
+    ("realtime.outputcpus", po::value<string>(&realtime->OutputCPUs)->default_value(""),
+      "CPUs to pin output writer threads to")
+    ("realtime.mlock", po::value<bool>(&realtime->LockMemory)->default_value(false),
+      "lock all memory after setup")
+    ("realtime.prefault", po::value<unsigned>(&realtime->PrefaultStackKB)->default_value(0),
+      "stack (kB) to prefault after setup")
+    ("realtime.jitter", po::value<bool>(&realtime->MeasureJitter)->default_value(false),
+      "measure and report loop wake-up lateness")
+    ("damping.wind", po::value<double>(&damping->Wind_s)->default_value(0),
+      "apparent and true wind averaging window (s), 0 for none")
+    ("damping.heading", po::value<double>(&damping->Heading_s)->default_value(0),
+      "true heading averaging window (s), 0 for none")
+    ("damping.speed", po::value<double>(&damping->Speed_s)->default_value(0),
+      "SOG averaging window (s), 0 for none")
+    ("damping.output", po::value<double>(&damping->OutputPeriod_s)->default_value(0),
+      "send damped MWV, MWD, HDT and VTG at this period (s) instead of per message, 0 for off")
   ;
   // Supported command line only options
   po::options_description options_cmdline_only("Command line only options");
@@ -48,6 +137,10 @@ bool SetOptions(int argc, char* argv[],
     ("config,f", po::value<string>(config_file)->default_value(default_config_file), 
       "configuration file name.")
     ("debug,d", "debug mode (send all data to stdout)")
+    ("replay,r", po::value<string>(replay_file),
+      "replay candump capture file instead of reading CAN port")
+    ("replayspeed", po::value<double>(replay_speed)->default_value(default_replay_speed),
+      "replay speed relative to capture time, 0 for as fast as possible")
   ;
   // Create list of all options for help
   po::options_description options_all("All options");
@@ -77,6 +170,12 @@ bool SetOptions(int argc, char* argv[],
     po::notify(vm);
   }
 
+  // Metrics every loop pass would also reset the loop histograms each pass
+  if (*metrics_period_s == 0) {
+    cerr << "metricsperiod must be at least 1 s.\n";
+    return false;
+  }
+
   // Handle debug mode
   if (vm.count("debug")) {
     cout << "Debug mode enabled!\n";
@@ -85,15 +184,39 @@ bool SetOptions(int argc, char* argv[],
   }
   
   // Display selected ports and streams
-  if (vm.count("canport"))
+  if (!replay_file->empty())
+    cout << "Replaying capture: " << *replay_file << " at speed " << *replay_speed << "\n";
+  else if (!bridge_dest->empty())
+    cout << "Bridging can port: " << *can_port << " to UDP " << *bridge_dest << "\n";
+  else if (!udp_in->empty())
+    cout << "Reading CAN frames over UDP on: " << *udp_in << "\n";
+  else if (vm.count("canport"))
     cout << "Reading from can port: " << *can_port << "\n";
   if (vm.count("auxin"))
     cout << "Reading auxiliary input serial from: "<< *aux_in_serial
          << " using baud rate: " << *aux_in_baud << "\n";
   if (vm.count("output"))
-    cout << "Writing NMEA0183 data to: " << *out_stream << "\n";
+    cout << "Writing " << *out_format << " data to: " << *out_stream << "\n";
+  if (!out2_stream->empty())
+    cout << "Writing " << *out2_format << " data to: " << *out2_stream << "\n";
   if (!fwd_stream->empty())
     cout << "Forwarding NMEA2000 data to: " << *fwd_stream << "\n";
+  if (!metrics_file->empty())
+    cout << "Writing metrics to: " << *metrics_file << " every " << *metrics_period_s << "s\n";
+  if (*ntp_shm_unit >= 0)
+    cout << "Feeding GNSS time to NTP SHM unit: " << *ntp_shm_unit << "\n";
+  if (!coalesce_pgns->empty())
+    cout << "Coalescing PGNs: " << *coalesce_pgns << "\n";
+  if (!wmm_file->empty())
+    cout << "Magnetic model file: " << *wmm_file << "\n";
+  if (!columns_file->empty())
+    cout << "Writing time series to: " << *columns_file << " every " << *columns_period_s << "s\n";
+  if (!analyzer_file->empty())
+    cout << "Writing bus analysis to: " << *analyzer_file << "\n";
+  if (damping->OutputPeriod_s > 0)
+    cout << "Damped output every " << damping->OutputPeriod_s << "s, windows wind "
+         << damping->Wind_s << "s, heading " << damping->Heading_s << "s, speed "
+         << damping->Speed_s << "s\n";
   if (vm.count("depth"))
     cout << "Depth offset set to: " << *depth_offset_ft << "ft\n";
 
@@ -1,6 +1,8 @@
 #ifndef OPTIONS_H
 #define OPTIONS_H
 #include <string>
+#include "Realtime.h"
+#include "RollingStats.h"
 
 bool SetOptions(
   // Inputs
@@ -12,7 +14,27 @@ bool SetOptions(
   std::string* aux_in_baud,
   std::string* out_stream,
   std::string* fwd_stream,
+  std::string* out_format,
+  std::string* out2_stream,
+  std::string* out2_format,
+  unsigned* out_buffer_kb,
+  std::string* metrics_file,
+  unsigned* metrics_period_s,
   double* depth_offset_ft,
+  tRealtimeOptions* realtime,
+  tDampingOptions* damping,
+  unsigned* can_rcvbuf_kb,
+  std::string* udp_in,
+  std::string* bridge_dest,
+  std::string* replay_file,
+  double* replay_speed,
+  std::string* heap_guard,
+  int* ntp_shm_unit,
+  std::string* coalesce_pgns,
+  std::string* wmm_file,
+  std::string* columns_file,
+  double* columns_period_s,
+  std::string* analyzer_file,
   bool* debug_mode);
 
 #endif // OPTIONS_H
\ No newline at end of file
@@ -0,0 +1,113 @@
+/*
+Realtime.cpp
+
+Optional real-time setup for the conversion process. See header for details.
+*/
+
+#include "Realtime.h"
+#include <iostream>
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+//*****************************************************************************
+// Parses list like "1,3" or "0-2" into CPU set. Returns false on bad list.
+static bool ParseCPUList(const string &List, cpu_set_t &CPUs) {
+  CPU_ZERO(&CPUs);
+  const char *p = List.c_str();
+  while (*p) {
+    char *end;
+    long First = strtol(p, &end, 10);
+    if (end == p || First < 0 || First >= CPU_SETSIZE) return false;
+    long Last = First;
+    p = end;
+    if (*p == '-') {
+      p++;
+      Last = strtol(p, &end, 10);
+      if (end == p || Last < First || Last >= CPU_SETSIZE) return false;
+      p = end;
+    }
+    for (long cpu = First; cpu <= Last; cpu++) CPU_SET(cpu, &CPUs);
+    if (*p == ',') p++;
+    else if (*p) return false;
+  }
+  return CPU_COUNT(&CPUs) > 0;
+}
+
+//*****************************************************************************
+static bool SetThreadAffinity(pthread_t Thread, const string &List, const char *Name) {
+  cpu_set_t CPUs;
+  if (!ParseCPUList(List, CPUs)) {
+    cerr << "Realtime: invalid CPU list '" << List << "' for " << Name << ".\n";
+    return false;
+  }
+  int err = pthread_setaffinity_np(Thread, sizeof(CPUs), &CPUs);
+  if (err != 0) {
+    cerr << "Realtime: pinning " << Name << " to CPUs " << List << " failed: " << strerror(err) << "\n";
+    return false;
+  }
+  cout << "Realtime: " << Name << " pinned to CPUs " << List << ".\n";
+  return true;
+}
+
+//*****************************************************************************
+static bool SetThreadPriority(pthread_t Thread, int Priority, const char *Name) {
+  struct sched_param Param;
+  memset(&Param, 0, sizeof(Param));
+  Param.sched_priority = Priority;
+  int err = pthread_setschedparam(Thread, SCHED_FIFO, &Param);
+  if (err != 0) {
+    cerr << "Realtime: SCHED_FIFO priority " << Priority << " for " << Name << " failed: " << strerror(err) << "\n";
+    return false;
+  }
+  cout << "Realtime: " << Name << " running SCHED_FIFO priority " << Priority << ".\n";
+  return true;
+}
+
+//*****************************************************************************
+// Touches stack pages so they are resident (and locked) before we need them
+static void __attribute__((noinline)) PrefaultStack(size_t Size) {
+  volatile char *Stack = (volatile char *)alloca(Size);
+  for (size_t i = 0; i < Size; i += 4096) Stack[i] = 0;
+}
+
+//*****************************************************************************
+bool ApplyRealtimeOptions(const tRealtimeOptions &Options, const pthread_t *OutputThreads, size_t OutputThreadCount) {
+  bool ok = true;
+  pthread_t LoopThread = pthread_self();
+  if (!Options.LoopCPUs.empty()) {
+    ok &= SetThreadAffinity(LoopThread, Options.LoopCPUs, "conversion loop");
+  }
+  for (size_t i = 0; i < OutputThreadCount && !Options.OutputCPUs.empty(); i++) {
+    ok &= SetThreadAffinity(OutputThreads[i], Options.OutputCPUs, "output writer");
+  }
+  if (Options.Priority > 0) {
+    ok &= SetThreadPriority(LoopThread, Options.Priority, "conversion loop");
+    int OutputPriority = (Options.Priority > 1) ? Options.Priority - 1 : 1;
+    for (size_t i = 0; i < OutputThreadCount; i++) {
+      ok &= SetThreadPriority(OutputThreads[i], OutputPriority, "output writer");
+    }
+  }
+  if (Options.LockMemory) {
+    // Keep freed memory in the process and avoid mmap for large blocks,
+    // so later allocations do not page fault.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      cerr << "Realtime: mlockall failed: " << strerror(errno) << "\n";
+      ok = false;
+    } else {
+      cout << "Realtime: memory locked.\n";
+    }
+  }
+  if (Options.PrefaultStackKB > 0) {
+    PrefaultStack((size_t)Options.PrefaultStackKB * 1024);
+    cout << "Realtime: prefaulted " << Options.PrefaultStackKB << "kB of stack.\n";
+  }
+  return ok;
+}
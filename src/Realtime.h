@@ -0,0 +1,37 @@
+/*
+Realtime.h
+
+Optional real-time setup for the conversion process: SCHED_FIFO priority,
+CPU pinning, locked memory and stack prefaulting. Each step reports whether
+it succeeded, and failures are not fatal, so the same config works with or
+without the needed privileges (CAP_SYS_NICE, CAP_IPC_LOCK).
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+
+struct tRealtimeOptions {
+  // SCHED_FIFO priority (1-99) for the receive/convert loop. 0 leaves the
+  // normal scheduler in use. Output writers run one step below.
+  int Priority;
+  // CPU list for the receive/convert loop, e.g. "3" or "2,3". Empty = any.
+  std::string LoopCPUs;
+  // CPU list for the output writer threads. Empty = any.
+  std::string OutputCPUs;
+  // mlockall() after setup
+  bool LockMemory;
+  // Stack to prefault (kB) after locking memory
+  unsigned PrefaultStackKB;
+  // Measure and report WaitForEvent() wake-up lateness
+  bool MeasureJitter;
+};
+
+// Applies options to the calling (main loop) thread and to the output
+// writer threads. Returns false if any requested step failed.
+bool ApplyRealtimeOptions(const tRealtimeOptions &Options, const pthread_t *OutputThreads, size_t OutputThreadCount);
+
+#endif // REALTIME_H
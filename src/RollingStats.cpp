@@ -0,0 +1,103 @@
+/*
+RollingStats.cpp
+
+Rolling window statistics. See header for details.
+*/
+
+#include "RollingStats.h"
+#include <N2kMsg.h>
+#include <math.h>
+
+const uint32_t tRollingWindow::Capacity;
+
+//*****************************************************************************
+void tRollingWindow::SetPeriod(unsigned long _Period_ms) {
+  Period_ms = _Period_ms;
+  MinInterval_ms = (Period_ms + Capacity - 1) / Capacity;
+}
+
+//*****************************************************************************
+bool tRollingWindow::Accept(unsigned long Now) const {
+  if (Period_ms == 0) return false;
+  if (Head == Tail) return true;
+  return Now - Times[(Head - 1) % Capacity] >= MinInterval_ms && Head - Tail < Capacity;
+}
+
+//*****************************************************************************
+void tRollingScalar::Add(double Value, unsigned long Now) {
+  Expire(Now);
+  if (!Accept(Now)) return;
+  uint32_t Pos = Head++;
+  Times[Pos % Capacity] = Now;
+  Values[Pos % Capacity] = Value;
+  Sum += Value;
+  // Queues keep only samples, which can still become min or max
+  while (MinLast != MinFirst && Values[MinQueue[(MinLast - 1) % Capacity] % Capacity] >= Value) MinLast--;
+  MinQueue[MinLast++ % Capacity] = Pos;
+  while (MaxLast != MaxFirst && Values[MaxQueue[(MaxLast - 1) % Capacity] % Capacity] <= Value) MaxLast--;
+  MaxQueue[MaxLast++ % Capacity] = Pos;
+}
+
+//*****************************************************************************
+void tRollingScalar::Expire(unsigned long Now) {
+  while (HasExpired(Now)) {
+    Sum -= Value(Tail);
+    if (MinFirst != MinLast && MinQueue[MinFirst % Capacity] == Tail) MinFirst++;
+    if (MaxFirst != MaxLast && MaxQueue[MaxFirst % Capacity] == Tail) MaxFirst++;
+    Tail++;
+  }
+  // Running sum would slowly collect rounding errors
+  if (Head == Tail) Sum = 0;
+}
+
+//*****************************************************************************
+double tRollingScalar::GetMean() const {
+  return (Head != Tail) ? Sum / (Head - Tail) : N2kDoubleNA;
+}
+
+//*****************************************************************************
+double tRollingScalar::GetMin() const {
+  return (MinFirst != MinLast) ? Value(MinQueue[MinFirst % Capacity]) : N2kDoubleNA;
+}
+
+//*****************************************************************************
+double tRollingScalar::GetMax() const {
+  return (MaxFirst != MaxLast) ? Value(MaxQueue[MaxFirst % Capacity]) : N2kDoubleNA;
+}
+
+//*****************************************************************************
+void tRollingAngle::Add(double Angle, unsigned long Now) {
+  Expire(Now);
+  if (!Accept(Now)) return;
+  uint32_t Pos = Head++;
+  Times[Pos % Capacity] = Now;
+  Sines[Pos % Capacity] = sin(Angle);
+  Cosines[Pos % Capacity] = cos(Angle);
+  SumSin += Sines[Pos % Capacity];
+  SumCos += Cosines[Pos % Capacity];
+}
+
+//*****************************************************************************
+void tRollingAngle::Expire(unsigned long Now) {
+  while (HasExpired(Now)) {
+    SumSin -= Sines[Tail % Capacity];
+    SumCos -= Cosines[Tail % Capacity];
+    Tail++;
+  }
+  if (Head == Tail) SumSin = SumCos = 0;
+}
+
+//*****************************************************************************
+double tRollingAngle::GetMean() const {
+  return (Head != Tail) ? atan2(SumSin, SumCos) : N2kDoubleNA;
+}
+
+//*****************************************************************************
+// sqrt(-2 ln R), where R is the length of the mean unit vector
+double tRollingAngle::GetStdDev() const {
+  if (Head == Tail) return N2kDoubleNA;
+  double R = hypot(SumSin, SumCos) / (Head - Tail);
+  if (R >= 1) return 0;
+  if (R <= 0) return M_PI;
+  return sqrt(-2 * log(R));
+}
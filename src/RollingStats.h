@@ -0,0 +1,99 @@
+/*
+RollingStats.h
+
+Rolling window statistics over the last Period_ms of samples, for damping
+noisy values like wind and heading. Samples are kept in fixed ring buffers
+with running sums, so adding a sample and reading mean, min or max are
+constant time (amortized) and nothing is allocated.
+
+A window keeps at most Capacity samples. Samples closer to the previous
+one than Period_ms/Capacity are skipped, so the ring never overflows and
+long windows are simply sampled more sparsely.
+
+Angles (radians) are averaged as unit vectors, so 359 and 1 degrees
+average to 0, not 180.
+*/
+
+#ifndef ROLLING_STATS_H
+#define ROLLING_STATS_H
+
+#include <stdint.h>
+
+// Damping windows (s), 0 disables. Output period (s) of damped sentences,
+// 0 for none.
+struct tDampingOptions {
+  double Wind_s;
+  double Heading_s;
+  double Speed_s;
+  double OutputPeriod_s;
+};
+
+//------------------------------------------------------------------------------
+// Sample times and ring positions shared by the windows below. Positions
+// count up forever, ring index is position modulo Capacity.
+class tRollingWindow {
+public:
+  static const uint32_t Capacity=512;
+
+protected:
+  unsigned long Period_ms;
+  unsigned long MinInterval_ms;
+  unsigned long Times[Capacity];
+  uint32_t Head; // Position of next sample
+  uint32_t Tail; // Position of oldest sample
+
+  bool Accept(unsigned long Now) const;
+  bool HasExpired(unsigned long Now) const { return Tail!=Head && Now-Times[Tail%Capacity]>Period_ms; }
+
+public:
+  tRollingWindow() : Period_ms(0), MinInterval_ms(0), Head(0), Tail(0) {}
+  void SetPeriod(unsigned long _Period_ms);
+  bool IsEnabled() const { return Period_ms>0; }
+  uint32_t GetCount() const { return Head-Tail; }
+  unsigned long GetPeriod() const { return Period_ms; }
+};
+
+//------------------------------------------------------------------------------
+// Mean, min and max of a scalar. Min and max use monotonic queues of ring
+// positions.
+class tRollingScalar : public tRollingWindow {
+protected:
+  double Values[Capacity];
+  double Sum;
+  uint32_t MinQueue[Capacity];
+  uint32_t MinFirst, MinLast;
+  uint32_t MaxQueue[Capacity];
+  uint32_t MaxFirst, MaxLast;
+
+  double Value(uint32_t Pos) const { return Values[Pos%Capacity]; }
+
+public:
+  tRollingScalar() : Sum(0), MinFirst(0), MinLast(0), MaxFirst(0), MaxLast(0) {}
+  void Add(double Value, unsigned long Now);
+  // Drops samples older than period. Call before reading.
+  void Expire(unsigned long Now);
+  // NA (N2kDoubleNA) when there are no samples
+  double GetMean() const;
+  double GetMin() const;
+  double GetMax() const;
+};
+
+//------------------------------------------------------------------------------
+// Circular mean of an angle, and circular standard deviation
+class tRollingAngle : public tRollingWindow {
+protected:
+  double Sines[Capacity];
+  double Cosines[Capacity];
+  double SumSin;
+  double SumCos;
+
+public:
+  tRollingAngle() : SumSin(0), SumCos(0) {}
+  void Add(double Angle, unsigned long Now);
+  void Expire(unsigned long Now);
+  // Mean in -pi..pi, NA when there are no samples
+  double GetMean() const;
+  double GetStdDev() const;
+};
+
+#endif // ROLLING_STATS_H
@@ -0,0 +1,79 @@
+/*
+SentencePool.cpp
+
+Shared, reference counted buffers for outgoing NMEA0183 sentences. See
+header for details.
+*/
+
+#include "SentencePool.h"
+#include <string.h>
+
+using namespace std;
+
+const size_t tSentence::MaxLen;
+
+//*****************************************************************************
+void tSentence::Release() {
+  if (Refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+    pPool->Put(this);
+  }
+}
+
+//*****************************************************************************
+tSentencePool::tSentencePool(size_t _Size)
+  : Sentences(0), Size(_Size), pFree(0), FreeCount(0), Formatted(0), Exhausted(0) {
+  if (Size < 1) Size = 1;
+  Sentences = new tSentence[Size];
+  for (size_t i = 0; i < Size; i++) {
+    Sentences[i].pPool = this;
+    Put(&Sentences[i]);
+  }
+}
+
+//*****************************************************************************
+tSentencePool::~tSentencePool() {
+  delete[] Sentences;
+}
+
+//*****************************************************************************
+void tSentencePool::Put(tSentence *pSentence) {
+  lock_guard<mutex> guard(Lock);
+  pSentence->pNext = pFree;
+  pFree = pSentence;
+  FreeCount++;
+}
+
+//*****************************************************************************
+tSentence* tSentencePool::Format(const tNMEA0183Msg &NMEA0183Msg) {
+  tSentence *pSentence;
+  {
+    lock_guard<mutex> guard(Lock);
+    pSentence = pFree;
+    if (pSentence == 0) {
+      Exhausted++;
+      return 0;
+    }
+    pFree = pSentence->pNext;
+    FreeCount--;
+  }
+  if (!NMEA0183Msg.GetMessage(pSentence->Data, tSentence::MaxLen - 2)) {
+    Put(pSentence);
+    return 0;
+  }
+  size_t Len = strlen(pSentence->Data);
+  pSentence->Data[Len++] = '\r';
+  pSentence->Data[Len++] = '\n';
+  pSentence->Len = Len;
+  pSentence->Refs.store(1, memory_order_relaxed);
+  Formatted++;
+  return pSentence;
+}
+
+//*****************************************************************************
+void tSentencePool::GetStats(tStats &Stats) {
+  lock_guard<mutex> guard(Lock);
+  Stats.Formatted = Formatted;
+  Stats.Exhausted = Exhausted;
+  Stats.InUse = Size - FreeCount;
+  Stats.Size = Size;
+}
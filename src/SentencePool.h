@@ -0,0 +1,88 @@
+/*
+SentencePool.h
+
+Shared, reference counted buffers for outgoing NMEA0183 sentences. A
+sentence is formatted once into a buffer from the pool, and every output
+sink gets the same buffer instead of formatting or copying it again. A
+sink keeping the sentence takes a reference and releases it after writing.
+The buffer goes back to the pool, when the last reference is released.
+
+All buffers are allocated at construction. Acquiring is done by the
+conversion thread, releasing also by sink writer threads.
+*/
+
+#ifndef SENTENCE_POOL_H
+#define SENTENCE_POOL_H
+
+#include <NMEA0183Msg.h>
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+class tSentencePool;
+
+//------------------------------------------------------------------------------
+class tSentence {
+  friend class tSentencePool;
+public:
+  // Longest sentence is 82 chars incl. CR/LF
+  static const size_t MaxLen=96;
+
+protected:
+  char Data[MaxLen];
+  uint16_t Len;
+  std::atomic<uint32_t> Refs;
+  tSentence *pNext;
+  tSentencePool *pPool;
+
+public:
+  tSentence() : Len(0), Refs(0), pNext(0), pPool(0) {}
+  // Sentence with CR/LF, not NUL terminated
+  const char* GetData() const { return Data; }
+  size_t GetLen() const { return Len; }
+  void AddRef() { Refs.fetch_add(1, std::memory_order_relaxed); }
+  void Release();
+};
+
+//------------------------------------------------------------------------------
+// Output which takes shared sentences
+class tSentenceSink {
+public:
+  virtual ~tSentenceSink() {}
+  // Sink takes a reference, if it keeps the sentence
+  virtual void SendSentence(tSentence *pSentence)=0;
+};
+
+//------------------------------------------------------------------------------
+class tSentencePool {
+  friend class tSentence;
+public:
+  struct tStats {
+    uint64_t Formatted;
+    uint64_t Exhausted;
+    uint32_t InUse;
+    uint32_t Size;
+  };
+
+protected:
+  tSentence *Sentences;
+  size_t Size;
+  std::mutex Lock;
+  tSentence *pFree;
+  size_t FreeCount;
+  uint64_t Formatted;
+  uint64_t Exhausted;
+
+  void Put(tSentence *pSentence);
+
+public:
+  tSentencePool(size_t _Size);
+  ~tSentencePool();
+  // Formats message with CR/LF into a free buffer holding one reference.
+  // Returns NULL, if message does not format or all buffers are in use.
+  tSentence* Format(const tNMEA0183Msg &NMEA0183Msg);
+  void GetStats(tStats &Stats);
+};
+
+#endif // SENTENCE_POOL_H
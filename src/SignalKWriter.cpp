@@ -0,0 +1,110 @@
+/*
+SignalKWriter.cpp
+
+Streaming writer for Signal K delta messages. See header for details.
+*/
+
+#include "SignalKWriter.h"
+#include <N2kMsg.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const char DeltaTail[] = "]}]}\n";
+
+//*****************************************************************************
+tSignalKWriter::tSignalKWriter(tNMEA0183Stream *_pStream, const char *_SourceLabel)
+  : pStream(_pStream), DeltaLen(0), DeltaValues(0), InUpdate(false),
+    DeltasWritten(0), ValuesWritten(0) {
+  SourceLabel[0] = 0;
+  if (_SourceLabel != 0) {
+    strncpy(SourceLabel, _SourceLabel, MaxLabelLen - 1);
+    SourceLabel[MaxLabelLen - 1] = 0;
+  }
+  Timestamp[0] = 0;
+}
+
+//*****************************************************************************
+void tSignalKWriter::BeginUpdate() {
+  struct timespec now;
+  struct tm utc;
+  clock_gettime(CLOCK_REALTIME, &now);
+  gmtime_r(&now.tv_sec, &utc);
+  snprintf(Timestamp, sizeof(Timestamp), "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
+           utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+           utc.tm_hour, utc.tm_min, utc.tm_sec, now.tv_nsec / 1000000);
+  DeltaLen = 0;
+  DeltaValues = 0;
+  InUpdate = true;
+}
+
+//*****************************************************************************
+void tSignalKWriter::OpenDelta() {
+  int len = snprintf(Delta, MaxDeltaLen,
+    "{\"context\":\"vessels.self\",\"updates\":[{\"source\":{\"label\":\"%s\"},"
+    "\"timestamp\":\"%s\",\"values\":[", SourceLabel, Timestamp);
+  DeltaLen = (len > 0 && (size_t)len < MaxDeltaLen) ? len : 0;
+  DeltaValues = 0;
+}
+
+//*****************************************************************************
+void tSignalKWriter::CloseDelta() {
+  if (DeltaValues == 0) return;
+  if (pStream != 0) {
+    pStream->write((const uint8_t *)Delta, DeltaLen);
+    pStream->write((const uint8_t *)DeltaTail, sizeof(DeltaTail) - 1);
+  }
+  DeltasWritten++;
+  ValuesWritten += DeltaValues;
+  DeltaLen = 0;
+  DeltaValues = 0;
+}
+
+//*****************************************************************************
+// Entry is one value object without separating comma
+void tSignalKWriter::AddEntry(const char *Entry, size_t EntryLen) {
+  if (!InUpdate) return;
+  if (DeltaLen > 0 && DeltaLen + 1 + EntryLen + sizeof(DeltaTail) > MaxDeltaLen) {
+    CloseDelta();
+  }
+  if (DeltaValues == 0) {
+    OpenDelta();
+    if (DeltaLen == 0 || DeltaLen + EntryLen + sizeof(DeltaTail) > MaxDeltaLen) return;
+  } else {
+    Delta[DeltaLen++] = ',';
+  }
+  memcpy(Delta + DeltaLen, Entry, EntryLen);
+  DeltaLen += EntryLen;
+  DeltaValues++;
+}
+
+//*****************************************************************************
+void tSignalKWriter::AddValue(const char *Path, double Value) {
+  if (N2kIsNA(Value) || !isfinite(Value)) return;
+  char Entry[MaxValueLen];
+  int len = snprintf(Entry, sizeof(Entry), "{\"path\":\"%s\",\"value\":%.9g}", Path, Value);
+  if (len > 0 && (size_t)len < sizeof(Entry)) AddEntry(Entry, len);
+}
+
+//*****************************************************************************
+void tSignalKWriter::AddPosition(double Latitude, double Longitude) {
+  if (N2kIsNA(Latitude) || N2kIsNA(Longitude)) return;
+  char Entry[MaxValueLen];
+  int len = snprintf(Entry, sizeof(Entry),
+    "{\"path\":\"navigation.position\",\"value\":{\"latitude\":%.8f,\"longitude\":%.8f}}",
+    Latitude, Longitude);
+  if (len > 0 && (size_t)len < sizeof(Entry)) AddEntry(Entry, len);
+}
+
+//*****************************************************************************
+void tSignalKWriter::EndUpdate() {
+  CloseDelta();
+  InUpdate = false;
+}
+
+//*****************************************************************************
+void tSignalKWriter::GetStats(tStats &Stats) const {
+  Stats.DeltasWritten = DeltasWritten;
+  Stats.ValuesWritten = ValuesWritten;
+}
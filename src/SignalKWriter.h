@@ -0,0 +1,61 @@
+/*
+SignalKWriter.h
+
+Streaming writer for Signal K delta messages. Values of one update are
+formatted straight into a fixed buffer and written to the output stream
+as one line of JSON, e.g.
+
+{"context":"vessels.self","updates":[{"source":{"label":"n2kconvert"},
+"timestamp":"2018-12-30T12:00:00.000Z","values":[{"path":"navigation.headingTrue","value":1.2}]}]}
+
+If the values do not fit in one line, the update is split into several
+deltas. No heap allocation happens after construction.
+*/
+
+#ifndef SIGNALK_WRITER_H
+#define SIGNALK_WRITER_H
+
+#include <NMEA0183.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class tSignalKWriter {
+public:
+  struct tStats {
+    uint64_t DeltasWritten;
+    uint64_t ValuesWritten;
+  };
+
+protected:
+  // Keeps each delta line within output sink record size
+  static const size_t MaxDeltaLen=1000;
+  static const size_t MaxValueLen=160;
+  static const size_t MaxLabelLen=32;
+
+  tNMEA0183Stream *pStream;
+  char SourceLabel[MaxLabelLen];
+  char Timestamp[32];
+  char Delta[MaxDeltaLen];
+  size_t DeltaLen;
+  uint16_t DeltaValues;
+  bool InUpdate;
+  uint64_t DeltasWritten;
+  uint64_t ValuesWritten;
+
+  void OpenDelta();
+  void CloseDelta();
+  void AddEntry(const char *Entry, size_t EntryLen);
+
+public:
+  tSignalKWriter(tNMEA0183Stream *_pStream, const char *_SourceLabel="n2kconvert");
+  // Starts collecting values of one update, time stamped with current time
+  void BeginUpdate();
+  // Values are in Signal K (SI) units. NA or non-finite values are skipped.
+  void AddValue(const char *Path, double Value);
+  void AddPosition(double Latitude, double Longitude);
+  // Writes collected values, if any
+  void EndUpdate();
+  void GetStats(tStats &Stats) const;
+};
+
+#endif // SIGNALK_WRITER_H
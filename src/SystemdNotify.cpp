@@ -0,0 +1,76 @@
+/*
+SystemdNotify.cpp
+
+Minimal sd_notify() protocol client. See header for details.
+*/
+
+#include "SystemdNotify.h"
+#include <iostream>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+//*****************************************************************************
+tSystemdNotify::tSystemdNotify() : fd(-1), WatchdogPeriod(0) {
+}
+
+//*****************************************************************************
+tSystemdNotify::~tSystemdNotify() {
+  if (fd >= 0) close(fd);
+}
+
+//*****************************************************************************
+bool tSystemdNotify::Open() {
+  const char *Path = getenv("NOTIFY_SOCKET");
+  if (Path == NULL || (Path[0] != '/' && Path[0] != '@')) return false;
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  size_t Len = strlen(Path);
+  if (Len >= sizeof(addr.sun_path)) return false;
+  memcpy(addr.sun_path, Path, Len);
+  // '@' is an abstract socket name
+  if (Path[0] == '@') addr.sun_path[0] = 0;
+  fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return false;
+  if (connect(fd, (struct sockaddr *)&addr, offsetof(struct sockaddr_un, sun_path) + Len) != 0) {
+    cerr << "Cannot connect to systemd notify socket: " << strerror(errno) << "\n";
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  // Watchdog applies to us only, if WATCHDOG_PID is unset or ours
+  const char *Usec = getenv("WATCHDOG_USEC");
+  const char *Pid = getenv("WATCHDOG_PID");
+  if (Usec != NULL && (Pid == NULL || atol(Pid) == (long)getpid())) {
+    WatchdogPeriod = chrono::microseconds(strtoull(Usec, NULL, 10) / 2);
+    LastKeepAlive = chrono::steady_clock::now();
+    if (IsWatchdogEnabled()) {
+      cout << "Systemd watchdog keep-alive every " << WatchdogPeriod.count() / 1000 << "ms.\n";
+    }
+  }
+  return true;
+}
+
+//*****************************************************************************
+bool tSystemdNotify::Send(const char *State) {
+  if (fd < 0) return false;
+  return send(fd, State, strlen(State), MSG_NOSIGNAL) >= 0;
+}
+
+//*****************************************************************************
+bool tSystemdNotify::KeepAliveDue() const {
+  return IsWatchdogEnabled() && chrono::steady_clock::now() - LastKeepAlive >= WatchdogPeriod;
+}
+
+//*****************************************************************************
+void tSystemdNotify::KeepAlive() {
+  Send("WATCHDOG=1");
+  LastKeepAlive = chrono::steady_clock::now();
+}
@@ -0,0 +1,40 @@
+/*
+SystemdNotify.h
+
+Minimal sd_notify() protocol client, so that n2kconvert can run as a
+Type=notify service with WatchdogSec= without depending on libsystemd.
+State strings are sent as datagrams to the socket in $NOTIFY_SOCKET.
+Without that variable (not started by systemd) everything is a no-op.
+*/
+
+#ifndef SYSTEMD_NOTIFY_H
+#define SYSTEMD_NOTIFY_H
+
+#include <chrono>
+#include <stdint.h>
+
+class tSystemdNotify {
+protected:
+  int fd;
+  // Keep-alive period, half of WatchdogSec. 0 = watchdog not enabled.
+  std::chrono::microseconds WatchdogPeriod;
+  std::chrono::steady_clock::time_point LastKeepAlive;
+
+  bool Send(const char *State);
+
+public:
+  tSystemdNotify();
+  ~tSystemdNotify();
+  // Connects to the notify socket and reads watchdog settings
+  bool Open();
+  bool IsEnabled() const { return fd >= 0; }
+  bool IsWatchdogEnabled() const { return WatchdogPeriod.count() > 0; }
+  bool Ready() { return Send("READY=1"); }
+  bool Stopping() { return Send("STOPPING=1"); }
+  // Keep-alive should be sent, if the loop has been doing real work since
+  // the last one. Otherwise it is left out and systemd restarts us.
+  bool KeepAliveDue() const;
+  void KeepAlive();
+};
+
+#endif // SYSTEMD_NOTIFY_H
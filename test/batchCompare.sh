@@ -0,0 +1,46 @@
+#! /bin/bash
+
+# Compares parallel n2kbatch conversion to a single threaded one. The sample
+# capture is given time stamps (one frame every 13.7 ms), converted with one
+# shard and with several, and the outputs must be identical. AIS multi
+# sentence message ids depend on how many were sent before, so they are
+# blanked before comparing. It is compared again with variation from the
+# World Magnetic Model, which must not depend on where a shard starts.
+# Usage: batchCompare.sh <build dir> [jobs] [shards] [WMM.COF]
+
+BUILD_DIR="${1:-.}"
+JOBS="${2:-4}"
+SHARDS="${3:-6}"
+SAMPLE="$(dirname "$0")/candumpSample1.txt"
+WMM="${4:-$(dirname "$0")/WMM2020.COF}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+awk 'BEGIN { t = 1545000000.0 }
+	/^</ {
+		data = ""
+		for (i = 3; i <= NF; i++) data = data toupper($i)
+		printf "(%.6f) can0 %s#%s\n", t, toupper(substr($1, 4, 8)), data
+		t += 0.0137
+	}' "$SAMPLE" > "$WORK/capture.log"
+
+blank_ais_id() {
+	sed -E 's/^(!AIVD[MO],[0-9],[0-9]),[0-9]?,([^*]*)\*[0-9A-F]{2}/\1,,\2/' "$1"
+}
+
+# compare <name> [n2kbatch options]
+compare() {
+	local NAME="$1"
+	shift
+	"$BUILD_DIR/n2kbatch" --jobs 1 --shards 1 "$@" "$WORK/capture.log" "$WORK/single.txt" || exit 1
+	"$BUILD_DIR/n2kbatch" --jobs "$JOBS" --shards "$SHARDS" "$@" "$WORK/capture.log" "$WORK/parallel.txt" || exit 1
+	if ! diff <(blank_ais_id "$WORK/single.txt") <(blank_ais_id "$WORK/parallel.txt") > "$WORK/diff"; then
+		echo "FAIL ($NAME): parallel output differs from single threaded output"
+		head -20 "$WORK/diff"
+		exit 1
+	fi
+	echo "OK ($NAME): $(wc -l < "$WORK/single.txt") sentences identical"
+}
+
+compare "bus variation"
+compare "WMM variation" --wmm "$WMM"
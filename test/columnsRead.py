@@ -0,0 +1,38 @@
+import argparse
+import math
+import mmap
+import struct
+
+# Reads a columnar time series file (see src/ColumnWriter.h) and prints
+# rows in a time range as CSV. Blocks outside the range are skipped by
+# their header page only.
+parser = argparse.ArgumentParser()
+parser.add_argument("-f", "--file", help="Input file.")
+parser.add_argument("--start", help="Start time (s since 1970).", type=float, default=0)
+parser.add_argument("--end", help="End time (s since 1970).", type=float, default=math.inf)
+args = parser.parse_args()
+
+with open(args.file, "rb") as f:
+	data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+	if data[:8] != b"N2KCOL1\0":
+		raise SystemExit("Not a column file")
+	version, columns, block_rows, block_size, header_size = struct.unpack_from("<5I", data, 8)
+	names = [data[64+32*c:64+32*c+24].rstrip(b"\0").decode() for c in range(columns)]
+	print(",".join(names))
+	blocks = (len(data) - header_size) // block_size
+	start_us = args.start * 1e6
+	end_us = args.end * 1e6
+	skipped = 0
+	for b in range(blocks):
+		base = header_size + b * block_size
+		rows = struct.unpack_from("<I", data, base)[0]
+		min_us, max_us = struct.unpack_from("<qq", data, base + 8)
+		if rows == 0 or max_us < start_us or min_us > end_us:
+			skipped += 1
+			continue
+		time = struct.unpack_from("<%dq" % rows, data, base + 4096)
+		values = [struct.unpack_from("<%dd" % rows, data, base + 4096 * (1 + c)) for c in range(1, columns)]
+		for r in range(rows):
+			if start_us <= time[r] <= end_us:
+				print(",".join([str(time[r])] + ["" if math.isnan(v[r]) else "%.9g" % v[r] for v in values]))
+	print(f"# {blocks} blocks, {skipped} skipped")
@@ -0,0 +1,37 @@
+#! /bin/bash
+
+# Time series rows must be stamped with the GNSS date, also when a device
+# on the bus sends magnetic variation (PGN 127258) with the date of its
+# model. The sample capture (GNSS date 2013-03-01) is given time stamps and
+# a variation sender dated 1997-05-19, converted with n2kbatch --columns,
+# and every row must fall on the GNSS date.
+# Usage: columnsVariation.sh <build dir>
+
+BUILD_DIR="${1:-.}"
+TEST_DIR="$(dirname "$0")"
+# 2013-03-01 as days since 1970
+GNSS_DAY=15765
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+# Variation 0.05 rad from source 0x23 every 100 frames, model date day 10000
+awk 'BEGIN { t = 1545000000.0 }
+	/^</ {
+		data = ""
+		for (i = 3; i <= NF; i++) data = data toupper($i)
+		printf "(%.6f) can0 %s#%s\n", t, toupper(substr($1, 4, 8)), data
+		if (++n % 100 == 0) printf "(%.6f) can0 19F11A23#00F11027F401FFFF\n", t
+		t += 0.0137
+	}' "$TEST_DIR/candumpSample1.txt" > "$WORK/capture.log"
+
+"$BUILD_DIR/n2kbatch" --columns "$WORK/track.n2kcol" "$WORK/capture.log" "$WORK/out.txt" || exit 1
+python3 "$TEST_DIR/columnsRead.py" -f "$WORK/track.n2kcol" > "$WORK/rows.csv" || exit 1
+
+ROWS=$(awk -F, 'NR > 1 && !/^#/' "$WORK/rows.csv" | wc -l)
+WRONG=$(awk -F, -v day="$GNSS_DAY" 'NR > 1 && !/^#/ && int($1 / 86400000000) != day' "$WORK/rows.csv" | wc -l)
+echo "$ROWS rows, $WRONG not on GNSS date"
+if [ "$ROWS" -eq 0 ] || [ "$WRONG" -ne 0 ]; then
+	echo "FAIL"
+	exit 1
+fi
+echo "OK"
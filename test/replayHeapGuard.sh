@@ -0,0 +1,21 @@
+#! /bin/bash
+
+# Replays a capture through n2kconvert as fast as possible, with the heap
+# guard set to trap. Fails if the main loop allocates from the heap.
+# Usage: replayHeapGuard.sh [n2kconvert binary] [capture file]
+
+N2KCONVERT="${1:-n2kconvert}"
+CAPTURE="${2:-$(dirname "$0")/candumpSample1.txt}"
+LOG="$(mktemp)"
+
+"$N2KCONVERT" --config /dev/null --output /dev/null \
+	--replay "$CAPTURE" --replayspeed 0 --heapguard trap > "$LOG" 2>&1
+STATUS=$?
+cat "$LOG"
+if [ $STATUS -ne 0 ] || ! grep -q "Heap allocations after steady state: 0" "$LOG"; then
+	echo "FAIL: heap allocations in main loop (exit status $STATUS)."
+	rm -f "$LOG"
+	exit 1
+fi
+echo "PASS: no heap allocations in main loop."
+rm -f "$LOG"
@@ -0,0 +1,59 @@
+#! /bin/bash
+
+# Stress test of n2kconvert on a virtual CAN bus, no CAN hardware needed.
+# For each frame rate, runs n2kconvert on vcan, loads the bus with
+# n2kloadgen and reports throughput, kernel drops, sentence output rate,
+# heading latency percentiles and average bus load seen by the bus
+# analyzer, which runs alongside conversion. Needs root for the vcan setup.
+# Usage: stressVcan.sh <build dir> [frame rates...]
+
+BUILD_DIR="${1:-.}"
+shift
+RATES="${*:-500 1000 1800 2500 4000 6000}"
+IFACE="${IFACE:-vcan0}"
+DURATION="${DURATION:-10}"
+AIS_BURST="${AIS_BURST:-50}"
+WORK="$(mktemp -d)"
+
+cleanup() {
+	[ -n "$PID" ] && kill "$PID" 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+if ! ip link show "$IFACE" > /dev/null 2>&1; then
+	modprobe vcan || exit 1
+	ip link add dev "$IFACE" type vcan || exit 1
+fi
+ip link set up "$IFACE" || exit 1
+mkfifo "$WORK/out"
+
+metric() {
+	awk -v name="n2kconvert_$1" '$1 == name { print $2 }' "${2:-$WORK/metrics}"
+}
+
+printf "%8s %10s %10s %10s %10s %12s %10s %10s %10s\n" \
+	"rate" "sent" "received" "krn drops" "out drops" "sentences/s" "p50 ms" "p99 ms" "bus load"
+for RATE in $RATES; do
+	rm -f "$WORK/metrics" "$WORK/bus"
+	"$BUILD_DIR/n2kconvert" --config /dev/null --canport "$IFACE" --output "$WORK/out" \
+		--metrics "$WORK/metrics" --metricsperiod 1 --analyzer "$WORK/bus" > "$WORK/n2kconvert.log" 2>&1 &
+	PID=$!
+	sleep 1
+	"$BUILD_DIR/n2kloadgen" --interface "$IFACE" --rate "$RATE" --duration "$DURATION" \
+		--aisburst "$AIS_BURST" --measure "$WORK/out" > "$WORK/loadgen.log" 2>&1
+	# Wait for a metrics update covering the whole run
+	sleep 2
+	kill "$PID"
+	wait "$PID" 2>/dev/null
+	PID=""
+	SENT=$(awk '/^Summary: .* frames in/ { print $2 }' "$WORK/loadgen.log")
+	SENTENCE_RATE=$(awk '/^Summary: .* sentences/ { gsub(/\(/, "", $4); print $4 }' "$WORK/loadgen.log")
+	P50=$(awk '/^Summary: heading/ { for (i = 1; i < NF; i++) if ($i == "p50") print $(i+1) }' "$WORK/loadgen.log")
+	P99=$(awk '/^Summary: heading/ { for (i = 1; i < NF; i++) if ($i == "p99") print $(i+1) }' "$WORK/loadgen.log")
+	BUS_LOAD=$(awk -v bits="$(metric bus_bits_total "$WORK/bus")" -v duration="$DURATION" \
+		'BEGIN { printf "%.1f%%", bits / (duration * 250000) * 100 }')
+	printf "%8s %10s %10s %10s %10s %12s %10s %10s %10s\n" "$RATE" "$SENT" \
+		"$(metric can_frames_received_total)" "$(metric can_kernel_drops_total)" \
+		"$(metric 'output_sentences_dropped_total{sink="output"}')" "$SENTENCE_RATE" "${P50%ms;}" "${P99%ms;}" "$BUS_LOAD"
+done
@@ -0,0 +1,59 @@
+#! /bin/bash
+
+# Loopback test of the UDP CAN input. n2kloadgen loads a virtual CAN bus at
+# full NMEA2000 bus rate, one n2kconvert bridges the bus to UDP on
+# localhost and another converts the frames it receives over UDP. Every
+# frame sent must arrive, with no loss. Needs root for the vcan setup.
+# Usage: udpLoopback.sh <build dir> [frame rate]
+
+BUILD_DIR="${1:-.}"
+# 250 kbit/s bus fully loaded with 8 byte extended frames
+RATE="${2:-1850}"
+IFACE="${IFACE:-vcan0}"
+PORT="${PORT:-29536}"
+DURATION="${DURATION:-30}"
+WORK="$(mktemp -d)"
+
+cleanup() {
+	[ -n "$BRIDGE_PID" ] && kill "$BRIDGE_PID" 2>/dev/null
+	[ -n "$CONVERT_PID" ] && kill "$CONVERT_PID" 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+if ! ip link show "$IFACE" > /dev/null 2>&1; then
+	modprobe vcan || exit 1
+	ip link add dev "$IFACE" type vcan || exit 1
+fi
+ip link set up "$IFACE" || exit 1
+mkfifo "$WORK/out"
+
+metric() {
+	awk -v name="n2kconvert_$2" '$1 == name { print $2 }' "$WORK/$1.prom"
+}
+
+"$BUILD_DIR/n2kconvert" --config /dev/null --udpin "127.0.0.1:$PORT" --output "$WORK/out" \
+	--metrics "$WORK/convert.prom" --metricsperiod 1 > "$WORK/convert.log" 2>&1 &
+CONVERT_PID=$!
+"$BUILD_DIR/n2kconvert" --config /dev/null --canport "$IFACE" --bridge "127.0.0.1:$PORT" \
+	--metrics "$WORK/bridge.prom" --metricsperiod 1 > "$WORK/bridge.log" 2>&1 &
+BRIDGE_PID=$!
+sleep 1
+"$BUILD_DIR/n2kloadgen" --interface "$IFACE" --rate "$RATE" --duration "$DURATION" \
+	--measure "$WORK/out" > "$WORK/loadgen.log" 2>&1
+# Wait for metrics updates covering the whole run
+sleep 2
+
+SENT=$(awk '/^Summary: .* frames in/ { print $2 }' "$WORK/loadgen.log")
+FORWARDED=$(metric bridge bridge_frames_forwarded_total)
+BRIDGE_DROPS=$(metric bridge can_kernel_drops_total)
+RECEIVED=$(metric convert can_frames_received_total)
+LOST=$(metric convert udp_frames_lost_total)
+REORDERED=$(metric convert udp_datagrams_reordered_total)
+echo "Sent $SENT frames at $RATE/s, bridged $FORWARDED (kernel drops $BRIDGE_DROPS)," \
+	"received $RECEIVED over UDP, lost $LOST, reordered datagrams $REORDERED"
+if [ -z "$SENT" ] || [ "$RECEIVED" != "$SENT" ] || [ "$LOST" != "0" ]; then
+	echo "FAIL"
+	exit 1
+fi
+echo "OK"
@@ -0,0 +1,69 @@
+#! /bin/bash
+
+# Reorder test of the UDP CAN input. Hand made datagrams are sent to
+# n2kconvert --udpin out of order, duplicated and with a gap, as a real
+# network may deliver them, and the frame counters are checked. Localhost
+# never reorders, so udpLoopback.sh does not cover this.
+# Usage: udpReorder.sh <build dir>
+
+BUILD_DIR="${1:-.}"
+PORT="${PORT:-29537}"
+WORK="$(mktemp -d)"
+
+cleanup() {
+	[ -n "$CONVERT_PID" ] && kill "$CONVERT_PID" 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+metric() {
+	awk -v name="n2kconvert_$1" '$1 == name { print $2 }' "$WORK/convert.prom"
+}
+
+"$BUILD_DIR/n2kconvert" --config /dev/null --udpin "127.0.0.1:$PORT" --output /dev/null \
+	--metrics "$WORK/convert.prom" --metricsperiod 1 > "$WORK/convert.log" 2>&1 &
+CONVERT_PID=$!
+sleep 1
+
+# Datagrams of two frames each, named by their first sequence number.
+# Bursts are sent back to back, so they are read well within the reorder
+# timeout; the pause after a burst is longer than the timeout.
+python3 - "$PORT" <<'EOF'
+import random, socket, struct, sys, time
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+session = random.getrandbits(32)
+
+def send(seq):
+	data = struct.pack("<IBBHIII", 0x554b324e, 1, 2, 0, session, seq, 0)
+	for i in range(2):
+		# PGN 127250 heading from source 1
+		data += struct.pack("<QIB3x8s", int(time.time() * 1e6), 0x09f11201, 8, bytes(8))
+	sock.sendto(data, ("127.0.0.1", int(sys.argv[1])))
+
+def burst(*seqs):
+	for seq in seqs:
+		send(seq)
+	time.sleep(0.2)
+
+burst(0)
+# 4 ahead of 2 and held, its duplicates held and late are dropped
+burst(4, 4, 2, 4)
+burst(6)
+# 8 missing, 10 held until the gap is given up, then 8 is late
+burst(10)
+burst(8, 12)
+EOF
+# Wait for a metrics update covering the whole run
+sleep 2
+
+RECEIVED=$(metric can_frames_received_total)
+LOST=$(metric udp_frames_lost_total)
+REORDERED=$(metric udp_datagrams_reordered_total)
+LATE=$(metric udp_datagrams_late_total)
+echo "Received $RECEIVED frames, lost $LOST, reordered datagrams $REORDERED, late $LATE"
+if [ "$RECEIVED" != "12" ] || [ "$LOST" != "2" ] || [ "$REORDERED" != "2" ] || [ "$LATE" != "3" ]; then
+	echo "FAIL (expected 12 received, 2 lost, 2 reordered, 3 late)"
+	exit 1
+fi
+echo "OK"
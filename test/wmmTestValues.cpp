@@ -0,0 +1,52 @@
+/*
+wmmTestValues.cpp
+
+Checks tMagneticModel against the declination test values NOAA publishes
+with WMM2020 (WMM2020_TEST_VALUES.txt). Built and run by wmmTestValues.sh.
+Usage: wmmTestValues <WMM2020.COF>
+*/
+
+#include "MagneticModel.h"
+#include <stdio.h>
+#include <string.h>
+
+struct tTestValue {
+  double DecimalYear;
+  double Altitude_km;
+  double Latitude;
+  double Longitude;
+  const char *Declination;
+};
+
+// Declination is given rounded to 0.01 degrees
+static const tTestValue TestValues[] = {
+  { 2020.0,   0,  80,   0, "-1.28" },
+  { 2020.0,   0,   0, 120, "0.16" },
+  { 2020.0,   0, -80, 240, "69.36" },
+  { 2020.0, 100,  80,   0, "-1.70" },
+  { 2020.0, 100,   0, 120, "0.16" },
+  { 2020.0, 100, -80, 240, "68.78" },
+  { 2022.5,   0,  80,   0, "0.01" },
+  { 2022.5,   0,   0, 120, "-0.06" },
+  { 2022.5,   0, -80, 240, "69.13" },
+  { 2022.5, 100,  80,   0, "-0.41" },
+  { 2022.5, 100,   0, 120, "-0.05" },
+  { 2022.5, 100, -80, 240, "68.55" }
+};
+
+int main(int argc, char *argv[]) {
+  tMagneticModel MagneticModel;
+  if (argc < 2 || !MagneticModel.Load(argv[1])) return 2;
+  int Failed = 0;
+  for (size_t i = 0; i < sizeof(TestValues) / sizeof(TestValues[0]); i++) {
+    const tTestValue &Test = TestValues[i];
+    char Declination[16];
+    snprintf(Declination, sizeof(Declination), "%.2f",
+             MagneticModel.CalcDeclination(Test.Latitude, Test.Longitude, Test.Altitude_km * 1000, Test.DecimalYear));
+    bool Ok = strcmp(Declination, Test.Declination) == 0;
+    printf("%.1f %5.0f km %4.0f %4.0f: %7s, expected %7s%s\n", Test.DecimalYear, Test.Altitude_km,
+           Test.Latitude, Test.Longitude, Declination, Test.Declination, Ok ? "" : "  FAIL");
+    if (!Ok) Failed++;
+  }
+  return Failed ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+#! /bin/bash
+
+# Checks the World Magnetic Model evaluation against the NOAA WMM2020 test
+# values. The model has no library dependencies, so the check is built
+# directly from the sources.
+# Usage: wmmTestValues.sh [WMM.COF]
+
+TEST_DIR="$(dirname "$0")"
+COF="${1:-$TEST_DIR/WMM2020.COF}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+"${CXX:-c++}" -std=c++11 -O2 -I"$TEST_DIR/../src" -o "$WORK/wmmTestValues" \
+	"$TEST_DIR/wmmTestValues.cpp" "$TEST_DIR/../src/MagneticModel.cpp" || exit 1
+if ! "$WORK/wmmTestValues" "$COF"; then
+	echo "FAIL: declination differs from WMM2020 test values"
+	exit 1
+fi
+echo "OK"